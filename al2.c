@@ -10,7 +10,7 @@
 
 void in_l2_tail(struct l2 ** pq, struct l2 * e)
 {
-  struct l2 *e1, *head, *tail;
+  struct l2 *head, *tail;
 
   if(*pq==NULL) // empty queue
   {
@@ -141,7 +141,7 @@ void print_back_l2( struct l2 *q, void (*print_content)(void *) )
 {
   struct l2 *e, *tail;
 
-  if(e==NULL)return;
+  if(q==NULL)return;
   
   e = q->prev;
   tail = q->prev;
@@ -0,0 +1,437 @@
+// bench.c
+// microbenchmarks of the simulator kernels, JSON results on stdout
+// make bench && ./bench [--reps=9] [--min-time=50] [--filter=name]
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <math.h>
+
+#include "ts_sim_int.h"
+
+#define BENCH_SET 4096 // pregenerated inputs, cycled
+
+struct bench {
+  char * name;
+  int param;          // queue length or depth, rule
+  void (*setup)(struct bench *b);
+  long (*run)(struct bench *b, long n);
+  void (*done)(struct bench *b);
+  // state
+  struct ts_sim * s;
+  struct l2 * q;
+  struct l2 * el;     // elements of the queue
+  void * c;           // their content
+  int * a;            // input sets
+  unsigned int rng;
+};
+
+volatile long bench_sink;
+
+double now_ns()
+{
+  struct timespec t;
+  clock_gettime(CLOCK_MONOTONIC,&t);
+  return t.tv_sec*1e9+t.tv_nsec;
+} /* now_ns */
+
+// torus of the kernels: d=3, k=16, half of the ports busy
+struct ts_sim * bench_sim()
+{
+  struct ts_sim *s = ts_sim_create();
+  int c, n_pc;
+
+  ts_sim_configure(s,"--d=3");
+  ts_sim_configure(s,"--k=16");
+  ts_sim_configure(s,"--seed=1");
+  ts_sim_init(s);
+  n_pc = s->n_nodes*s->n_ports;
+  for(c=0;c<n_pc;c++) s->port_pkt_all[c] = (c*2654435761u>>16)&1 ? (struct l2 *)s : NULL;
+  return s;
+} /* bench_sim */
+
+void bench_free_sim(struct bench *b)
+{
+  int c, n_pc = b->s->n_nodes*b->s->n_ports;
+
+  for(c=0;c<n_pc;c++) b->s->port_pkt_all[c]=NULL;
+  ts_sim_destroy(b->s);
+  free(b->a);
+  free(b->el);
+  free(b->c);
+} /* bench_free_sim */
+
+///////////////////////////////////// event queue: hold model at depth param
+
+void eq_setup(struct bench *b)
+{
+  struct event *e;
+  int j;
+
+  b->rng=1;
+  b->el = malloc(b->param*sizeof(struct l2));
+  b->c = malloc(b->param*sizeof(struct event));
+  if( b->el==NULL || b->c==NULL ) error_exit("no memory for bench");
+  e = (struct event *)b->c;
+  b->q = NULL;
+  for(j=0;j<b->param;j++)
+  {
+    e[j].at = ran_expo(0.01,&b->rng)*b->param;
+    b->el[j].content = e+j;
+    in_l2_order(&b->q,b->el+j,event_compare_content);
+  }
+} /* eq_setup */
+
+// pop the earliest event, insert it again later: one insert and one pop
+long eq_run(struct bench *b, long n)
+{
+  struct l2 *el;
+  struct event *e;
+  long c;
+
+  for(c=0;c<n;c++)
+  {
+    el = from_l2_head(&b->q);
+    e = (struct event *)el->content;
+    e->at += 1+ran_expo(0.01,&b->rng)*b->param;
+    in_l2_order(&b->q,el,event_compare_content);
+  }
+  return ((struct event *)b->q->content)->at;
+} /* eq_run */
+
+void eq_done(struct bench *b)
+{
+  free(b->el);
+  free(b->c);
+} /* eq_done */
+
+///////////////////////////////////// node queue: first suitable of param packets
+
+void nq_setup(struct bench *b)
+{
+  struct packet *p;
+  int j, m, d=3;
+
+  b->rng=2;
+  b->el = malloc(b->param*sizeof(struct l2));
+  b->c = malloc(b->param*sizeof(struct packet));
+  b->a = malloc(b->param*d*sizeof(int));
+  if( b->el==NULL || b->c==NULL || b->a==NULL ) error_exit("no memory for bench");
+  p = (struct packet *)b->c;
+  b->q = NULL;
+  for(j=0;j<b->param;j++)
+  {
+    memset(p+j,0,sizeof(struct packet));
+    p[j].dports = 0;
+    p[j].da = b->a+j*d;
+    // one productive dimension: a packet suits one port of six
+    for(m=0;m<d;m++) p[j].da[m]=0;
+    p[j].da[rand_r(&b->rng)%d] = (rand_r(&b->rng)&1)?3:-3;
+    b->el[j].content = p+j;
+    in_l2_tail(&b->q,b->el+j);
+  }
+} /* nq_setup */
+
+// extract the first packet for a port, append it back
+long nq_run(struct bench *b, long n)
+{
+  struct l2 *el;
+  long c, found=0;
+  int np;
+
+  for(c=0;c<n;c++)
+  {
+    np = c%6;
+    el = from_l2(&b->q,&np,packet_find_content);
+    if(el!=NULL)
+    {
+      found++;
+      in_l2_tail(&b->q,el);
+    }
+  }
+  return found;
+} /* nq_run */
+
+void nq_done(struct bench *b)
+{
+  free(b->el);
+  free(b->c);
+  free(b->a);
+} /* nq_done */
+
+///////////////////////////////////// addresses
+
+// BENCH_SET pairs of node addresses
+void addr_setup(struct bench *b)
+{
+  int j, d;
+
+  b->s = bench_sim();
+  d = b->s->d;
+  b->rng = 3;
+  b->a = malloc(2*BENCH_SET*d*sizeof(int));
+  if( b->a==NULL ) error_exit("no memory for bench");
+  for(j=0;j<BENCH_SET;j++)
+  {
+    node_index(rand_r(&b->rng)%b->s->n_nodes,b->a+2*j*d,d,b->s->kk);
+    node_index(rand_r(&b->rng)%b->s->n_nodes,b->a+(2*j+1)*d,d,b->s->kk);
+  }
+} /* addr_setup */
+
+long adr_diff_run(struct bench *b, long n)
+{
+  int d=b->s->d, da[d], *a;
+  long c, h=0;
+
+  for(c=0;c<n;c++)
+  {
+    a = b->a+2*(c%BENCH_SET)*d;
+    adr_diff(b->s,a,a+d,da);
+    h += da[0]+da[d-1];
+  }
+  return h;
+} /* adr_diff_run */
+
+long next_hop_run(struct bench *b, long n)
+{
+  int d=b->s->d, ii[d];
+  long c, h=0;
+
+  for(c=0;c<n;c++)
+  {
+    next_hop(b->a+2*(c%BENCH_SET)*d,ii,c%b->s->n_ports,d,b->s->kk);
+    h += node_number(ii,d,b->s->kk);
+  }
+  return h;
+} /* next_hop_run */
+
+///////////////////////////////////// switching rules
+
+// BENCH_SET packets at random nodes, not at their destinations
+void rule_setup(struct bench *b)
+{
+  struct packet *p;
+  int j, d, *i;
+
+  addr_setup(b);
+  d = b->s->d;
+  b->c = malloc(BENCH_SET*sizeof(struct packet));
+  b->el = malloc(BENCH_SET*d*sizeof(int)); // da
+  if( b->c==NULL || b->el==NULL ) error_exit("no memory for bench");
+  p = (struct packet *)b->c;
+  for(j=0;j<BENCH_SET;j++)
+  {
+    memset(p+j,0,sizeof(struct packet));
+    i = b->a+2*j*d;
+    p[j].dest = i+d;
+    p[j].da = (int *)b->el+j*d;
+    p[j].back = -1;
+    p[j].dports = 0;
+    if(memcmp(i,i+d,d*sizeof(int))==0) i[d]=(i[d]+1)%b->s->kk[0];
+    adr_diff(b->s,p[j].dest,i,p[j].da);
+    // node number kept in the source address slot
+    b->a[2*j*d] = node_number(i,d,b->s->kk);
+  }
+} /* rule_setup */
+
+long rule_run(struct bench *b, long n)
+{
+  int (*rule[6])(struct ts_sim *, struct packet *, int, unsigned int *) =
+    {sw_pkt_rule_a,sw_pkt_rule_b,sw_pkt_rule_c,sw_pkt_rule_d,sw_pkt_rule_e,sw_pkt_rule_f};
+  int (*f)(struct ts_sim *, struct packet *, int, unsigned int *) = rule[b->param-'a'];
+  struct packet *p = (struct packet *)b->c;
+  int d=b->s->d, j;
+  long c, h=0;
+
+  for(c=0;c<n;c++)
+  {
+    j = c%BENCH_SET;
+    h += f(b->s,p+j,b->a[2*j*d],&b->rng);
+  }
+  return h;
+} /* rule_run */
+
+///////////////////////////////////// random numbers
+
+long ran_expo_run(struct bench *b, long n)
+{
+  double t=0;
+  long c;
+
+  for(c=0;c<n;c++) t += ran_expo(0.01,&b->rng);
+  return (long)t;
+} /* ran_expo_run */
+
+// uniforms of a batch followed by its gaps
+void gaps_setup(struct bench *b)
+{
+  double *u;
+  int j;
+
+  b->rng = 1;
+  b->c = malloc(BENCH_SET*(sizeof(double)+sizeof(simtime)));
+  if( b->c==NULL ) error_exit("no memory for bench");
+  u = b->c;
+  for(j=0;j<BENCH_SET;j++) u[j] = rand_r(&b->rng) / (RAND_MAX + 1.0);
+} /* gaps_setup */
+
+void gaps_done(struct bench *b)
+{
+  free(b->c);
+} /* gaps_done */
+
+// gen_batch kernel: vectorised exponential gaps of a batch
+long expo_gaps_run(struct bench *b, long n)
+{
+  double *u = b->c;
+  simtime *dt = (simtime *)(u+BENCH_SET);
+  long c, m, h=0;
+
+  for(c=0;c<n;c+=m)
+  {
+    m = (n-c<BENCH_SET) ? n-c : BENCH_SET;
+    expo_gaps(u,dt,m,0.01);
+    h += dt[m-1];
+  }
+  return h;
+} /* expo_gaps_run */
+
+// the same gaps by libm log, one call per element
+long expo_gaps_libm_run(struct bench *b, long n)
+{
+  double *u = b->c, g;
+  simtime *dt = (simtime *)(u+BENCH_SET);
+  long c, a, m, h=0;
+
+  for(c=0;c<n;c+=m)
+  {
+    m = (n-c<BENCH_SET) ? n-c : BENCH_SET;
+    for(a=0;a<m;a++)
+    {
+      g = -log(1-u[a]) / 0.01;
+      dt[a] = (g<1) ? 1 : (simtime)g;
+    }
+    h += dt[m-1];
+  }
+  return h;
+} /* expo_gaps_libm_run */
+
+long gen_dest_run(struct bench *b, long n)
+{
+  int d=b->s->d, dest[d];
+  long c, h=0;
+
+  for(c=0;c<n;c++)
+  {
+    gen_dest(b->a+2*(c%BENCH_SET)*d,dest,d,b->s->kk,&b->rng);
+    h += dest[0];
+  }
+  return h;
+} /* gen_dest_run */
+
+long gen_dest_number_run(struct bench *b, long n)
+{
+  long c, h=0;
+
+  for(c=0;c<n;c++) h += gen_dest_number(c%b->s->n_nodes,b->s->n_nodes,&b->rng);
+  return h;
+} /* gen_dest_number_run */
+
+/////////////////////////////////////
+
+struct bench benches[] = {
+  {"event_queue_hold", 16, eq_setup, eq_run, eq_done},
+  {"event_queue_hold", 256, eq_setup, eq_run, eq_done},
+  {"event_queue_hold", 4096, eq_setup, eq_run, eq_done},
+  {"node_queue_find", 4, nq_setup, nq_run, nq_done},
+  {"node_queue_find", 32, nq_setup, nq_run, nq_done},
+  {"node_queue_find", 256, nq_setup, nq_run, nq_done},
+  {"adr_diff", 0, addr_setup, adr_diff_run, bench_free_sim},
+  {"next_hop_node_number", 0, addr_setup, next_hop_run, bench_free_sim},
+  {"sw_pkt_rule", 'a', rule_setup, rule_run, bench_free_sim},
+  {"sw_pkt_rule", 'b', rule_setup, rule_run, bench_free_sim},
+  {"sw_pkt_rule", 'c', rule_setup, rule_run, bench_free_sim},
+  {"sw_pkt_rule", 'd', rule_setup, rule_run, bench_free_sim},
+  {"sw_pkt_rule", 'e', rule_setup, rule_run, bench_free_sim},
+  {"sw_pkt_rule", 'f', rule_setup, rule_run, bench_free_sim},
+  {"ran_expo", 0, addr_setup, ran_expo_run, bench_free_sim},
+  {"expo_gaps", 0, gaps_setup, expo_gaps_run, gaps_done},
+  {"expo_gaps_libm", 0, gaps_setup, expo_gaps_libm_run, gaps_done},
+  {"gen_dest", 0, addr_setup, gen_dest_run, bench_free_sim},
+  {"gen_dest_number", 0, addr_setup, gen_dest_number_run, bench_free_sim},
+  {NULL}
+};
+
+int double_compare(const void *x1, const void *x2)
+{
+  double a=*(double *)x1, b=*(double *)x2;
+  return (a<b)?-1:(a>b)?1:0;
+} /* double_compare */
+
+// the number of operations is doubled until a repetition takes min_ns,
+// after a warm up run; the median of reps repetitions is reported with the
+// minimum and the relative spread (max-min)/median
+void bench_run(struct bench *b, int reps, double min_ns, int first)
+{
+  double t, ns[reps];
+  long n=1000;
+  int r;
+
+  b->setup(b);
+  bench_sink += b->run(b,n);
+  for(;;)
+  {
+    t = now_ns();
+    bench_sink += b->run(b,n);
+    t = now_ns()-t;
+    if(t>=min_ns) break;
+    n *= 2;
+  }
+  for(r=0;r<reps;r++)
+  {
+    t = now_ns();
+    bench_sink += b->run(b,n);
+    ns[r] = (now_ns()-t)/n;
+  }
+  b->done(b);
+  qsort(ns,reps,sizeof(double),double_compare);
+  printf("%s    {\"name\": \"%s\", ",first?"":",\n",b->name);
+  if(b->param>='a' && b->param<='f') printf("\"rule\": \"%c\", ",b->param);
+  else if(b->param>0) printf("\"length\": %d, ",b->param);
+  printf("\"ops\": %ld, \"ns_per_op\": %.3f, \"min_ns\": %.3f, \"spread\": %.4f}",
+    n,ns[reps/2],ns[0],(ns[reps-1]-ns[0])/ns[reps/2]);
+  fflush(stdout);
+} /* bench_run */
+
+int main(int argc, char *argv[])
+{
+  int j, reps=9, first=1;
+  double min_ms=50;
+  char *filter=NULL;
+
+  for(j=1;j<argc;j++)
+  {
+    if(strncmp(argv[j],"--reps=",7)==0) reps=atoi(argv[j]+7);
+    else if(strncmp(argv[j],"--min-time=",11)==0) min_ms=atof(argv[j]+11);
+    else if(strncmp(argv[j],"--filter=",9)==0) filter=argv[j]+9;
+    else
+    {
+      printf("USAGE: bench [--reps=repetitions] [--min-time=ms per repetition] [--filter=name]\n");
+      return 1;
+    }
+  }
+  if(reps<1) reps=1;
+
+  printf("{\n  \"bench\": \"ts\",\n  \"reps\": %d,\n  \"min_time_ms\": %g,\n  \"results\": [\n",reps,min_ms);
+  for(j=0;benches[j].name!=NULL;j++)
+  {
+    if(filter!=NULL && strstr(benches[j].name,filter)==NULL) continue;
+    bench_run(benches+j,reps,min_ms*1e6,first);
+    first=0;
+  }
+  printf("\n  ]\n}\n");
+  return 0;
+} /* main */
+
+// bench.c end
@@ -0,0 +1,244 @@
+// ts_cache.c
+// memory-mapped result cache
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "ts_cache.h"
+
+#define CACHE_MAGIC "TSCACHE2"
+#define CACHE_INIT (1<<16) // initial file size, bytes
+#define CACHE_SLOTS 1024 // initial index slots, a power of 2
+
+// file: header, then records and indexes (8 byte aligned) up to used; the
+// index is an open-addressed table of slots keyed by the record hash, at
+// half load a twice larger one is appended and the old one is abandoned
+struct cache_hdr {
+  char magic[8];
+  unsigned long long used;
+  unsigned long long n;     // occupied slots
+  unsigned long long idx;   // offset of the index
+  unsigned long long slots;
+};
+
+struct cache_slot {
+  unsigned long long hash;
+  unsigned long long off;   // of the record, 0: empty
+};
+
+struct cache_rec {
+  unsigned long long hash;
+  unsigned int klen;  // key with its terminating 0
+  unsigned int dlen;
+  unsigned int dead;  // invalidated or replaced
+  unsigned int pad;
+};
+
+#define REC_SIZE(r) ((sizeof(struct cache_rec)+(r)->klen+(r)->dlen+7) & ~7UL)
+
+unsigned long long ts_fnv1a(const void *p, size_t n, unsigned long long h)
+{
+  const unsigned char *b = p;
+  size_t j;
+
+  for(j=0;j<n;j++)
+  {
+    h ^= b[j];
+    h *= 1099511628211ULL;
+  }
+  return h;
+} /* ts_fnv1a */
+
+// map the whole file, it may have grown by another process or been replaced
+static int cache_map(struct ts_cache *c)
+{
+  struct stat st;
+
+  if(fstat(c->fd,&st)<0) return 0;
+  if(c->map!=NULL && (size_t)st.st_size==c->size) return 1;
+  if(c->map!=NULL) munmap(c->map,c->size);
+  c->map = NULL;
+  c->size = st.st_size;
+  c->map = mmap(NULL,c->size,PROT_READ|PROT_WRITE,MAP_SHARED,c->fd,0);
+  if(c->map==MAP_FAILED) { c->map=NULL; return 0; }
+  return 1;
+} /* cache_map */
+
+struct ts_cache * ts_cache_open(char *path)
+{
+  struct ts_cache *c = calloc(1,sizeof(struct ts_cache));
+  struct cache_hdr *h;
+  struct stat st;
+
+  if( c==NULL ) return NULL;
+  c->fd = open(path,O_RDWR|O_CREAT,0644);
+  if( c->fd<0 ) { free(c); return NULL; }
+  flock(c->fd,LOCK_EX);
+  if(fstat(c->fd,&st)==0 && st.st_size==0 && ftruncate(c->fd,CACHE_INIT)==0)
+  {
+    cache_map(c);
+    if(c->map!=NULL)
+    {
+      h = (struct cache_hdr *)c->map;
+      memcpy(h->magic,CACHE_MAGIC,8);
+      h->idx = sizeof(struct cache_hdr);
+      h->slots = CACHE_SLOTS;
+      h->used = h->idx+h->slots*sizeof(struct cache_slot);
+      h->n = 0;
+    }
+  }
+  else cache_map(c);
+  flock(c->fd,LOCK_UN);
+  if(c->map==NULL || memcmp(c->map,CACHE_MAGIC,8)!=0)
+  {
+    ts_cache_close(c);
+    return NULL;
+  }
+  return c;
+} /* ts_cache_open */
+
+// the slot of key, or the empty slot ending its probe sequence, with the
+// lock held
+static struct cache_slot * cache_slot(struct ts_cache *c, char *key, unsigned long long hash)
+{
+  struct cache_hdr *h = (struct cache_hdr *)c->map;
+  struct cache_slot *t = (struct cache_slot *)(c->map+h->idx);
+  struct cache_rec *r;
+  unsigned long long j, m = h->slots-1;
+  unsigned int kl = strlen(key)+1;
+
+  for(j=hash&m; t[j].off!=0; j=(j+1)&m)
+  {
+    if(t[j].hash!=hash) continue;
+    r = (struct cache_rec *)(c->map+t[j].off);
+    if(r->klen==kl && memcmp(r+1,key,kl)==0) break;
+  }
+  return t+j;
+} /* cache_slot */
+
+// the live record of key, with the lock held
+static struct cache_rec * cache_find(struct ts_cache *c, char *key, unsigned long long hash)
+{
+  struct cache_slot *t = cache_slot(c,key,hash);
+  struct cache_rec *r;
+
+  if(t->off==0) return NULL;
+  r = (struct cache_rec *)(c->map+t->off);
+  return r->dead ? NULL : r;
+} /* cache_find */
+
+// grows the file to need bytes at least, with the exclusive lock held
+static int cache_grow(struct ts_cache *c, size_t need)
+{
+  size_t grow;
+
+  if(need <= c->size) return 1;
+  for(grow=c->size; grow<need; grow*=2);
+  return ftruncate(c->fd,grow)==0 && cache_map(c);
+} /* cache_grow */
+
+// appends an index of twice the slots holding the live records, with the
+// exclusive lock held
+static int cache_rehash(struct ts_cache *c)
+{
+  struct cache_hdr *h = (struct cache_hdr *)c->map;
+  struct cache_slot *t, *u;
+  unsigned long long j, k, m, slots = 2*h->slots;
+
+  if(!cache_grow(c,h->used+slots*sizeof(struct cache_slot))) return 0;
+  h = (struct cache_hdr *)c->map;
+  t = (struct cache_slot *)(c->map+h->idx);
+  u = (struct cache_slot *)(c->map+h->used);
+  memset(u,0,slots*sizeof(struct cache_slot));
+  m = slots-1;
+  h->n = 0;
+  for(j=0;j<h->slots;j++)
+  {
+    if(t[j].off==0 || ((struct cache_rec *)(c->map+t[j].off))->dead) continue;
+    for(k=t[j].hash&m; u[k].off!=0; k=(k+1)&m);
+    u[k] = t[j];
+    h->n++;
+  }
+  h->idx = h->used;
+  h->slots = slots;
+  h->used += slots*sizeof(struct cache_slot);
+  return 1;
+} /* cache_rehash */
+
+// copies at most size bytes of the data of key, returns its length or -1
+long ts_cache_get(struct ts_cache *c, char *key, void *data, long size)
+{
+  struct cache_rec *r;
+  long n=-1;
+
+  flock(c->fd,LOCK_SH);
+  if(cache_map(c) && (r = cache_find(c,key,ts_fnv1a(key,strlen(key),TS_FNV_BASIS))) != NULL)
+  {
+    n = r->dlen;
+    if(size>0) memcpy(data,(char *)(r+1)+r->klen,(n<size)?n:size);
+  }
+  flock(c->fd,LOCK_UN);
+  if(n<0) c->misses++;
+  else c->hits++;
+  return n;
+} /* ts_cache_get */
+
+// appends the record, an older record of the key becomes dead and its
+// slot points to the new one
+void ts_cache_put(struct ts_cache *c, char *key, void *data, long size)
+{
+  struct cache_hdr *h;
+  struct cache_slot *t;
+  struct cache_rec *r, rec;
+  unsigned long long hash = ts_fnv1a(key,strlen(key),TS_FNV_BASIS);
+
+  flock(c->fd,LOCK_EX);
+  if(!cache_map(c)) { flock(c->fd,LOCK_UN); return; }
+  h = (struct cache_hdr *)c->map;
+  if(2*(h->n+1) > h->slots && !cache_rehash(c)) { flock(c->fd,LOCK_UN); return; }
+  memset(&rec,0,sizeof(rec));
+  rec.hash = hash;
+  rec.klen = strlen(key)+1;
+  rec.dlen = size;
+  h = (struct cache_hdr *)c->map;
+  if(!cache_grow(c,h->used+REC_SIZE(&rec))) { flock(c->fd,LOCK_UN); return; }
+  h = (struct cache_hdr *)c->map;
+  r = (struct cache_rec *)(c->map+h->used);
+  *r = rec;
+  memcpy(r+1,key,rec.klen);
+  memcpy((char *)(r+1)+rec.klen,data,size);
+  t = cache_slot(c,key,hash);
+  if(t->off!=0) ((struct cache_rec *)(c->map+t->off))->dead=1;
+  else h->n++;
+  t->hash = hash;
+  t->off = h->used;
+  h->used += REC_SIZE(&rec);
+  flock(c->fd,LOCK_UN);
+} /* ts_cache_put */
+
+// returns 1 when a record of key was invalidated
+int ts_cache_del(struct ts_cache *c, char *key)
+{
+  struct cache_rec *r=NULL;
+
+  flock(c->fd,LOCK_EX);
+  if(cache_map(c) && (r = cache_find(c,key,ts_fnv1a(key,strlen(key),TS_FNV_BASIS))) != NULL) r->dead=1;
+  flock(c->fd,LOCK_UN);
+  return r!=NULL;
+} /* ts_cache_del */
+
+void ts_cache_close(struct ts_cache *c)
+{
+  if(c==NULL) return;
+  if(c->map!=NULL) munmap(c->map,c->size);
+  close(c->fd);
+  free(c);
+} /* ts_cache_close */
+
+// ts_cache.c end
@@ -0,0 +1,29 @@
+// ts_cache.h
+// result cache: records keyed by a configuration string (FNV-1a hash and the
+// string itself) appended to a memory-mapped file shared by processes, found
+// by a hash index in the file
+
+#ifndef __TS_CACHE__
+#define __TS_CACHE__
+
+#include <stddef.h>
+
+struct ts_cache {
+  int fd;
+  char * map;
+  size_t size;    // mapped bytes
+  int hits, misses;
+};
+
+unsigned long long ts_fnv1a(const void *p, size_t n, unsigned long long h);
+struct ts_cache * ts_cache_open(char *path);
+long ts_cache_get(struct ts_cache *c, char *key, void *data, long size);
+void ts_cache_put(struct ts_cache *c, char *key, void *data, long size);
+int ts_cache_del(struct ts_cache *c, char *key);
+void ts_cache_close(struct ts_cache *c);
+
+#define TS_FNV_BASIS 14695981039346656037ULL
+
+#endif
+
+// ts_cache.h end
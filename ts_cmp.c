@@ -0,0 +1,178 @@
+// ts_cmp.c
+// rule comparison with common random numbers
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+
+#include "ts_cmp.h"
+
+// t quantiles 0.975 of 1..30 degrees of freedom, then normal
+static double t975[30] = {
+  12.706, 4.303, 3.182, 2.776, 2.571, 2.447, 2.365, 2.306, 2.262, 2.228,
+  2.201, 2.179, 2.160, 2.145, 2.131, 2.120, 2.110, 2.101, 2.093, 2.086,
+  2.080, 2.074, 2.069, 2.064, 2.060, 2.056, 2.052, 2.048, 2.045, 2.042 };
+
+struct ts_cmp * ts_cmp_create()
+{
+  struct ts_cmp *q = calloc(1,sizeof(struct ts_cmp));
+  if( q==NULL ) error_exit("no memory for rule comparison");
+  q->rules=strdup("abcdef");
+  q->reps=5;
+  return q;
+} /* ts_cmp_create */
+
+// one comparison parameter, returns 0 for an unknown key or value
+int ts_cmp_configure(struct ts_cmp *q, char *a)
+{
+  if(strcmp(a,"--r=all")==0) return 1;
+  else if(strncmp(a,"--cmp-rules=",12)==0) {free(q->rules);q->rules=strdup(a+12);return strspn(a+12,"abcdef")==strlen(a+12) && strlen(a+12)>=2;}
+  else if(strncmp(a,"--reps=",7)==0) {q->reps=atoi(a+7);return q->reps>0;}
+  else return 0;
+} /* ts_cmp_configure */
+
+// a simulation parameter, checked on a scratch simulation
+int ts_cmp_add_argument(struct ts_cmp *q, char *a)
+{
+  struct ts_sim *s = ts_sim_create();
+  int ok = ts_sim_configure(s,a);
+
+  ts_sim_destroy(s);
+  if(!ok) return 0;
+  q->argv = realloc(q->argv,(q->argc+1)*sizeof(char *));
+  if( q->argv==NULL ) error_exit("no memory for rule comparison");
+  q->argv[q->argc] = strdup(a);
+  if( q->argv[q->argc]==NULL ) error_exit("no memory for rule comparison");
+  q->argc++;
+  return 1;
+} /* ts_cmp_add_argument */
+
+// configured simulation of rule and seed (0: configured), without time series
+struct ts_sim * cmp_sim(struct ts_cmp *q, int rule, unsigned int seed)
+{
+  struct ts_sim *s = ts_sim_create();
+  char a[64];
+  int j;
+
+  for(j=0;j<q->argc;j++) ts_sim_configure(s,q->argv[j]);
+  snprintf(a,sizeof(a),"--r=%c",rule);
+  ts_sim_configure(s,a);
+  if(seed!=0)
+  {
+    snprintf(a,sizeof(a),"--seed=%u",seed);
+    ts_sim_configure(s,a);
+  }
+  ts_sim_configure(s,"--stats-interval=0");
+  return s;
+} /* cmp_sim */
+
+// per replication the stream is generated once, then the rules replay it in
+// parallel; sizes, classes and faults follow the same seed in every rule
+void ts_cmp_run(struct ts_cmp *q)
+{
+  struct ts_sim *s;
+  struct inj_buf *tr;
+  int rep, j;
+
+  s = cmp_sim(q,'a',0);
+  if(s->model!='s') error_exit("rule comparison simulates (--model=sim)");
+  q->seed = (s->seed!=0) ? s->seed : (unsigned)time(NULL);
+  ts_sim_destroy(s);
+
+  q->n_r = strlen(q->rules);
+  q->run = calloc(q->reps*q->n_r,sizeof(struct ts_cmp_run));
+  if( q->run==NULL ) error_exit("no memory for rule comparison");
+
+  for(rep=0;rep<q->reps;rep++)
+  {
+    s = cmp_sim(q,q->rules[0],q->seed+rep);
+    tr = ts_sim_trace(s);
+    ts_sim_destroy(s);
+    q->packets += (double)tr->cnt/q->reps;
+
+#pragma omp parallel for schedule(dynamic,1)
+    for(j=0;j<q->n_r;j++)
+    {
+      struct ts_sim *r = cmp_sim(q,q->rules[j],q->seed+rep);
+      struct ts_cmp_run *p = q->run+rep*q->n_r+j;
+
+      r->trace = tr;
+      ts_sim_run(r);
+      p->throughput = r->stat.delevered_packets/(double)r->st;
+      p->latency = (r->stat.delevered_packets>0)?r->stat.sum_of_latency/r->stat.delevered_packets:0;
+
+if(r->dbg>0)
+{
+printf("replication %d rule %c: throughput %le latency %le\n",rep,q->rules[j],p->throughput,p->latency);
+}
+      ts_sim_destroy(r);
+    }
+    ts_sim_trace_free(tr);
+  }
+} /* ts_cmp_run */
+
+// mean and 95% half width of the mean of n values
+void cmp_ci(double *x, int n, double *mean, double *hw)
+{
+  double m=0, v=0;
+  int j;
+
+  for(j=0;j<n;j++) m+=x[j];
+  m/=n;
+  for(j=0;j<n;j++) v+=(x[j]-m)*(x[j]-m);
+  *mean=m;
+  if(n<2) {*hw=NAN; return;}
+  *hw = ((n-1<=30)?t975[n-2]:1.960)*sqrt(v/(n-1)/n);
+} /* cmp_ci */
+
+// means per rule, and differences to the first rule paired by replication
+void ts_cmp_print(struct ts_cmp *q, FILE *f)
+{
+  double *x, m, h, m2, h2;
+  int j, rep, n=q->n_r;
+
+  x = malloc(q->reps*sizeof(double));
+  if( x==NULL ) error_exit("no memory for rule comparison");
+  fprintf(f,"***** Rule comparison *****\n");
+  fprintf(f,"configuration:");
+  for(j=0;j<q->argc;j++) fprintf(f," %s",q->argv[j]);
+  fprintf(f,"\nreplications %d (seeds %u-%u), common injection stream of %.0f packets per replication\n\n",
+    q->reps,q->seed,q->seed+q->reps-1,q->packets);
+  fprintf(f,"%4s %14s %14s %14s %14s\n","rule","throughput","+-","latency","+-");
+  for(j=0;j<n;j++)
+  {
+    for(rep=0;rep<q->reps;rep++) x[rep]=q->run[rep*n+j].throughput;
+    cmp_ci(x,q->reps,&m,&h);
+    for(rep=0;rep<q->reps;rep++) x[rep]=q->run[rep*n+j].latency;
+    cmp_ci(x,q->reps,&m2,&h2);
+    fprintf(f,"%4c %14e %14e %14e %14e\n",q->rules[j],m,h,m2,h2);
+  }
+  fprintf(f,"\npaired differences to rule %c (95%% confidence, pkt/mtu and mtu):\n",q->rules[0]);
+  for(j=1;j<n;j++)
+  {
+    for(rep=0;rep<q->reps;rep++) x[rep]=q->run[rep*n+j].throughput-q->run[rep*n].throughput;
+    cmp_ci(x,q->reps,&m,&h);
+    for(rep=0;rep<q->reps;rep++) x[rep]=q->run[rep*n+j].latency-q->run[rep*n].latency;
+    cmp_ci(x,q->reps,&m2,&h2);
+    fprintf(f,"rule %c - %c: throughput %le +- %le%s, latency %le +- %le%s\n",q->rules[j],q->rules[0],
+      m,h,(fabs(m)>h)?" *":"",m2,h2,(fabs(m2)>h2)?" *":"");
+  }
+  if(q->reps<2) fprintf(f,"(confidence intervals need --reps=2 or more)\n");
+  else fprintf(f,"(* the interval excludes 0)\n");
+  free(x);
+} /* ts_cmp_print */
+
+void ts_cmp_destroy(struct ts_cmp *q)
+{
+  int j;
+
+  for(j=0;j<q->argc;j++) free(q->argv[j]);
+  free(q->argv);
+  free(q->rules);
+  free(q->run);
+  free(q);
+} /* ts_cmp_destroy */
+
+// ts_cmp.c end
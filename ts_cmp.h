@@ -0,0 +1,41 @@
+// ts_cmp.h
+// rule comparison with common random numbers: per replication one injection
+// stream is generated and replayed by a simulation of every rule, the rules
+// are compared by paired differences over the replications
+
+#ifndef __TS_CMP__
+#define __TS_CMP__
+
+#include <stdio.h>
+
+#include "ts_sim.h"
+
+struct ts_cmp_run {
+  double throughput;  // delivered packets per mtu
+  double latency;     // mean packet latency, mtu
+};
+
+struct ts_cmp {
+  // param
+  char * rules;       // default abcdef, the first is the reference
+  int reps;           // replications, seeds seed, seed+1, ...
+  char ** argv;       // configuration of the simulations
+  int argc;
+
+  // var
+  int n_r;
+  unsigned int seed;
+  struct ts_cmp_run * run; // replication x rule
+  double packets;     // injected packets per replication, mean
+};
+
+struct ts_cmp * ts_cmp_create();
+int ts_cmp_configure(struct ts_cmp *q, char *a);
+int ts_cmp_add_argument(struct ts_cmp *q, char *a);
+void ts_cmp_run(struct ts_cmp *q);
+void ts_cmp_print(struct ts_cmp *q, FILE *f);
+void ts_cmp_destroy(struct ts_cmp *q);
+
+#endif
+
+// ts_cmp.h end
@@ -0,0 +1,175 @@
+// ts_perf.c
+// hardware performance counters of code regions
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+
+#ifdef __linux__
+#include <sys/ioctl.h>
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#endif
+
+#include "ts_perf.h"
+
+static char *perf_name[TS_PERF_EVENTS] = {"cycles","instructions","LLC misses","branch misses","task clock (ns)"};
+static char *region_name[TS_PERF_REGIONS] = {"main loop","gen_pkt","free_chan","sw_pkt"};
+
+#ifdef __linux__
+
+static long perf_event_open(struct perf_event_attr *a, int group)
+{
+  return syscall(__NR_perf_event_open, a, 0, -1, group, 0);
+} /* perf_event_open */
+
+// counters of user mode of the calling thread: counting in the kernel is
+// usually not permitted, and leaves out the cost of the reads
+struct ts_perf * ts_perf_open()
+{
+  struct ts_perf *c = calloc(1,sizeof(struct ts_perf));
+  struct perf_event_attr a;
+  int e;
+  unsigned int type[TS_PERF_EVENTS] = {PERF_TYPE_HARDWARE,PERF_TYPE_HARDWARE,PERF_TYPE_HARDWARE,PERF_TYPE_HARDWARE,PERF_TYPE_SOFTWARE};
+  unsigned long long config[TS_PERF_EVENTS] = {PERF_COUNT_HW_CPU_CYCLES,PERF_COUNT_HW_INSTRUCTIONS,
+    PERF_COUNT_HW_CACHE_MISSES,PERF_COUNT_HW_BRANCH_MISSES,PERF_COUNT_SW_TASK_CLOCK};
+
+  if( c==NULL ) return NULL;
+  c->leader=-1;
+  for(e=0;e<TS_PERF_EVENTS;e++)
+  {
+    memset(&a,0,sizeof(a));
+    a.size=sizeof(a);
+    a.type=type[e];
+    a.config=config[e];
+    a.disabled=(c->leader<0);
+    a.exclude_kernel=1;
+    a.exclude_hv=1;
+    a.read_format=PERF_FORMAT_GROUP;
+    c->fd[e]=perf_event_open(&a,c->leader);
+    if(c->fd[e]<0)
+    {
+      snprintf(c->err,sizeof(c->err),"%s",strerror(errno));
+      continue;
+    }
+    if(c->leader<0) c->leader=c->fd[e];
+    c->pos[e]=c->n++;
+  }
+  if(c->leader>=0)
+  {
+    ioctl(c->leader,PERF_EVENT_IOC_RESET,PERF_IOC_FLAG_GROUP);
+    ioctl(c->leader,PERF_EVENT_IOC_ENABLE,PERF_IOC_FLAG_GROUP);
+  }
+  return c;
+} /* ts_perf_open */
+
+// all counters of the group by one read
+static void perf_read(struct ts_perf *c, unsigned long long *v)
+{
+  unsigned long long b[1+TS_PERF_EVENTS];
+  int e;
+
+  if(read(c->leader,b,sizeof(b)) < (ssize_t)((1+c->n)*sizeof(unsigned long long)))
+  {
+    memset(v,0,TS_PERF_EVENTS*sizeof(unsigned long long));
+    return;
+  }
+  for(e=0;e<TS_PERF_EVENTS;e++) v[e]=(c->fd[e]>=0)?b[1+c->pos[e]]:0;
+} /* perf_read */
+
+void ts_perf_close(struct ts_perf *c)
+{
+  int e;
+
+  if(c==NULL) return;
+  for(e=0;e<TS_PERF_EVENTS;e++) if(c->fd[e]>=0) close(c->fd[e]);
+  free(c);
+} /* ts_perf_close */
+
+#else
+
+struct ts_perf * ts_perf_open()
+{
+  struct ts_perf *c = calloc(1,sizeof(struct ts_perf));
+  int e;
+
+  if( c==NULL ) return NULL;
+  c->leader=-1;
+  for(e=0;e<TS_PERF_EVENTS;e++) c->fd[e]=-1;
+  snprintf(c->err,sizeof(c->err),"perf_event_open is Linux only");
+  return c;
+} /* ts_perf_open */
+
+static void perf_read(struct ts_perf *c, unsigned long long *v)
+{
+  memset(v,0,TS_PERF_EVENTS*sizeof(unsigned long long));
+} /* perf_read */
+
+void ts_perf_close(struct ts_perf *c)
+{
+  free(c);
+} /* ts_perf_close */
+
+#endif
+
+// regions count inclusively: sw_pkt is also inside gen_pkt and free_chan;
+// a recursive entry counts once
+void ts_perf_begin(struct ts_perf *c, int region)
+{
+  struct ts_perf_region *r = c->r+region;
+
+  r->calls++;
+  if(c->leader<0 || r->depth++ > 0) return;
+  perf_read(c,r->at);
+} /* ts_perf_begin */
+
+void ts_perf_end(struct ts_perf *c, int region)
+{
+  struct ts_perf_region *r = c->r+region;
+  unsigned long long v[TS_PERF_EVENTS];
+  int e;
+
+  if(c->leader<0 || --r->depth > 0) return;
+  perf_read(c,v);
+  for(e=0;e<TS_PERF_EVENTS;e++) r->sum[e]+=v[e]-r->at[e];
+} /* ts_perf_end */
+
+// per simulated event for the main loop, per call for the other regions
+void ts_perf_print(struct ts_perf *c, FILE *f, double events)
+{
+  struct ts_perf_region *r;
+  int g, e;
+
+  fprintf(f,"***** Performance counters *****\n");
+  if(c==NULL || c->leader<0)
+  {
+    fprintf(f,"counters unavailable (%s)\n\n",(c!=NULL)?c->err:"no memory");
+    return;
+  }
+  if(c->n<TS_PERF_EVENTS)
+  {
+    fprintf(f,"unavailable");
+    for(g=e=0;e<TS_PERF_EVENTS;e++) if(c->fd[e]<0) fprintf(f,"%s%s",(g++==0)?": ":", ",perf_name[e]);
+    fprintf(f," (%s)\n",c->err);
+  }
+  for(g=0;g<TS_PERF_REGIONS;g++)
+  {
+    r=c->r+g;
+    if(r->calls==0) continue;
+    if(g==TS_PERF_MAIN) fprintf(f,"%s: %.0f events\n",region_name[g],events);
+    else fprintf(f,"%s: %ld calls\n",region_name[g],r->calls);
+    for(e=0;e<TS_PERF_EVENTS;e++)
+    {
+      if(c->fd[e]<0) continue;
+      fprintf(f,"  %s: %llu, %le per %s\n",perf_name[e],r->sum[e],
+        r->sum[e]/((g==TS_PERF_MAIN)?events:r->calls),(g==TS_PERF_MAIN)?"event":"call");
+    }
+    if(c->fd[0]>=0 && c->fd[1]>=0 && r->sum[0]>0)
+      fprintf(f,"  instructions per cycle: %le\n",(double)r->sum[1]/r->sum[0]);
+  }
+  fprintf(f,"\n");
+} /* ts_perf_print */
+
+// ts_perf.c end
@@ -0,0 +1,38 @@
+// ts_perf.h
+// hardware performance counters (Linux perf_event_open) of code regions:
+// one counter group of the calling thread read at the region entry and exit
+
+#ifndef __TS_PERF__
+#define __TS_PERF__
+
+#include <stdio.h>
+
+#define TS_PERF_EVENTS 5 // cycles, instructions, LLC misses, branch misses, task clock
+
+enum { TS_PERF_MAIN, TS_PERF_GEN, TS_PERF_FREE, TS_PERF_SW, TS_PERF_REGIONS };
+
+struct ts_perf_region {
+  long calls;
+  int depth;  // entered, not left
+  unsigned long long at[TS_PERF_EVENTS];  // counters at the entry
+  unsigned long long sum[TS_PERF_EVENTS];
+};
+
+struct ts_perf {
+  int fd[TS_PERF_EVENTS]; // -1: unavailable
+  int pos[TS_PERF_EVENTS]; // position in the group read
+  int leader;
+  int n;                  // counters opened
+  char err[128];          // why a counter is unavailable
+  struct ts_perf_region r[TS_PERF_REGIONS];
+};
+
+struct ts_perf * ts_perf_open();
+void ts_perf_begin(struct ts_perf *c, int region);
+void ts_perf_end(struct ts_perf *c, int region);
+void ts_perf_print(struct ts_perf *c, FILE *f, double events);
+void ts_perf_close(struct ts_perf *c);
+
+#endif
+
+// ts_perf.h end
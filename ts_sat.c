@@ -0,0 +1,318 @@
+// ts_sat.c
+// saturation search over switching rules
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#ifdef _OPENMP
+#include <omp.h>
+#endif
+
+#include "ts_sat.h"
+
+#define SAT_CHECKS 20  // checkpoints of a probe run
+#define SAT_WARMUP 2   // checkpoints before the growth test
+#define SAT_GROW 3     // consecutive checkpoints of growth: unstable
+#define SAT_SLACK 0.02 // share of offered packets not delivered regarded as loss
+
+struct sat_task {
+  int r;
+  struct ts_sat_probe p;
+};
+
+struct ts_sat * ts_sat_create()
+{
+  struct ts_sat *q = calloc(1,sizeof(struct ts_sat));
+  if( q==NULL ) error_exit("no memory for saturation search");
+  q->rules=strdup("abcdef");
+  q->tol=0.02;
+  q->max_rounds=30;
+  return q;
+} /* ts_sat_create */
+
+// one --sat-key=value parameter, returns 0 for an unknown key or value
+int ts_sat_configure(struct ts_sat *q, char *a)
+{
+  if(strcmp(a,"--find-saturation")==0) return 1;
+  else if(strncmp(a,"--sat-rules=",12)==0) {free(q->rules);q->rules=strdup(a+12);return strspn(a+12,"abcdef")==strlen(a+12) && a[12]!=0;}
+  else if(strncmp(a,"--sat-probes=",13)==0) {q->n_probes=atoi(a+13);return q->n_probes>=0;}
+  else if(strncmp(a,"--sat-tol=",10)==0) {q->tol=atof(a+10);return q->tol>0 && q->tol<1;}
+  else if(strncmp(a,"--sat-rounds=",13)==0) {q->max_rounds=atoi(a+13);return q->max_rounds>0;}
+  else if(strncmp(a,"--cache=",8)==0) {free(q->cache_file);q->cache_file=strdup(a+8);return q->cache_file!=NULL;}
+  else if(strcmp(a,"--cache-force")==0) {q->cache_force=1;return 1;}
+  else return 0;
+} /* ts_sat_configure */
+
+// a simulation parameter of the probes, checked on a scratch simulation;
+// closed loop sources and collectives set their own load, lambda does not
+// bracket them, so they are rejected
+int ts_sat_add_argument(struct ts_sat *q, char *a)
+{
+  struct ts_sim *s = ts_sim_create();
+  int ok = ts_sim_configure(s,a) && s->src_kind!='c' && s->src_kind!='r' && s->coll==0;
+
+  ts_sim_destroy(s);
+  if(!ok) return 0;
+  q->argv = realloc(q->argv,(q->argc+1)*sizeof(char *));
+  if( q->argv==NULL ) error_exit("no memory for saturation search");
+  q->argv[q->argc] = strdup(a);
+  if( q->argv[q->argc]==NULL ) error_exit("no memory for saturation search");
+  q->argc++;
+  return 1;
+} /* ts_sat_add_argument */
+
+// configured simulation of rule and lambda, without time series
+struct ts_sim * sat_sim(struct ts_sat *q, int rule, double lambda)
+{
+  struct ts_sim *s = ts_sim_create();
+  char a[64];
+  int j;
+  double sum;
+
+  for(j=0;j<q->argc;j++) ts_sim_configure(s,q->argv[j]);
+  snprintf(a,sizeof(a),"--r=%c",rule);
+  ts_sim_configure(s,a);
+  if(lambda>0)
+  {
+    snprintf(a,sizeof(a),"--lambda=%.17g",lambda);
+    ts_sim_configure(s,a);
+  }
+  // traffic classes: lambda of the mix, the class rates keep their ratios
+  for(j=0,sum=0;j<s->n_class;j++) sum+=s->cls[j].lambda;
+  if(sum>0 && lambda>0) for(j=0;j<s->n_class;j++) s->cls[j].lambda*=lambda/sum;
+  else if(sum>0) s->lambda=sum;
+  ts_sim_configure(s,"--stats-interval=0");
+  return s;
+} /* sat_sim */
+
+// run a probe in checkpoints of maxst/SAT_CHECKS: unstable when the
+// network drops packets or the queues grow while delivering less than
+// offered for SAT_GROW checkpoints, or the second half of the run lost
+// more than SAT_SLACK of the offered packets; a cached probe is not run
+void sat_probe(struct ts_sat *q, int rule, struct ts_sat_probe *r)
+{
+  struct ts_sim *s = sat_sim(q,rule,r->lambda);
+  struct ts_stat t, t0, h;
+  simtime dt;
+  int j, more, grow=0, hit=0;
+  double gen, del, lambda=r->lambda;
+  char key[4096];
+
+  strcpy(key,"probe ");
+  if(q->cache==NULL || !ts_sim_describe(s,key+6,sizeof(key)-6)) key[0]=0;
+  if(key[0]!=0 && !q->cache_force)
+  {
+#pragma omp critical(ts_cache)
+    hit = ts_cache_get(q->cache,key,r,sizeof(struct ts_sat_probe)) == sizeof(struct ts_sat_probe);
+  }
+  if(hit && r->lambda==lambda)
+  {
+    ts_sim_destroy(s);
+    return;
+  }
+  r->lambda=lambda;
+
+  ts_sim_init(s);
+  dt = s->max_st/SAT_CHECKS;
+  if(dt<1) dt=1;
+  ts_sim_stats(s,&t0);
+  h=t0;
+  for(j=1;;j++)
+  {
+    more = ts_sim_step(s,j*dt);
+    ts_sim_stats(s,&t);
+    if(j>SAT_WARMUP)
+    {
+      gen = t.generated_packets-t0.generated_packets;
+      del = t.delevered_packets+t.undeliverable_packets-t0.delevered_packets-t0.undeliverable_packets;
+      if(t.dropped_packets>t0.dropped_packets) grow=SAT_GROW;
+      else if(del<(1-SAT_SLACK)*gen && t.queued_packets>t0.queued_packets) grow++;
+      else grow=0;
+    }
+    if(j==SAT_CHECKS/2) h=t;
+    t0=t;
+    if(grow>=SAT_GROW || !more) break;
+  }
+  gen = t.generated_packets-h.generated_packets;
+  del = t.delevered_packets+t.undeliverable_packets-h.delevered_packets-h.undeliverable_packets;
+  r->stable = grow<SAT_GROW && del>=(1-SAT_SLACK)*gen;
+  r->st = t.st;
+  r->offered = t.generated_packets/(double)t.st;
+  r->throughput = t.delevered_packets/(double)t.st;
+  r->latency = (t.delevered_packets>0)?t.sum_of_latency/t.delevered_packets:0;
+
+if(s->dbg>0)
+{
+printf("probe rule %c lambda %le: %s at %ld (mtu)\n",rule,r->lambda,r->stable?"stable":"unstable",t.st);
+}
+  if(key[0]!=0)
+  {
+#pragma omp critical(ts_cache)
+    ts_cache_put(q->cache,key,r,sizeof(struct ts_sat_probe));
+  }
+  ts_sim_destroy(s);
+} /* sat_probe */
+
+void sat_add_probe(struct ts_sat_rule *r, struct ts_sat_probe *p)
+{
+  if(r->n_probe==r->cap_probe)
+  {
+    r->cap_probe = r->cap_probe*2+8;
+    r->probe = realloc(r->probe,r->cap_probe*sizeof(struct ts_sat_probe));
+    if( r->probe==NULL ) error_exit("no memory for probes");
+  }
+  r->probe[r->n_probe++] = *p;
+} /* sat_add_probe */
+
+// bracket from all probes of the rule: hi the least unstable lambda, lo the
+// greatest stable lambda below it (noisy verdicts near saturation are
+// resolved toward the lower bound)
+void sat_bracket(struct ts_sat_rule *r)
+{
+  int j;
+
+  r->hi=0;
+  for(j=0;j<r->n_probe;j++)
+    if(!r->probe[j].stable && (r->hi==0 || r->probe[j].lambda<r->hi)) r->hi=r->probe[j].lambda;
+  r->lo=0;
+  for(j=0;j<r->n_probe;j++)
+    if(r->probe[j].stable && r->probe[j].lambda>r->lo && (r->hi==0 || r->probe[j].lambda<r->hi)) r->lo=r->probe[j].lambda;
+} /* sat_bracket */
+
+// rounds of n_probes parallel probes per rule: doubling lambda from --lambda
+// until a probe is unstable, then (n_probes+1)-section of the bracket
+void ts_sat_run(struct ts_sat *q)
+{
+  struct ts_sim *s;
+  struct sat_task *task;
+  struct ts_sat_rule *r;
+  double lambda0, b;
+  int j, c, n_task, n_open, P=q->n_probes;
+
+  s = sat_sim(q,'a',0);
+  lambda0 = s->lambda;
+  if(s->model!='s') error_exit("saturation search simulates (--model=sim)");
+  if(lambda0<=0) error_exit("saturation search starts from --lambda > 0");
+  ts_sim_destroy(s);
+  if(q->cache_file!=NULL && (q->cache = ts_cache_open(q->cache_file)) == NULL)
+    error_exit("cannot open cache file");
+
+  q->n_r = strlen(q->rules);
+  q->r = calloc(q->n_r,sizeof(struct ts_sat_rule));
+  if( q->r==NULL ) error_exit("no memory for saturation search");
+  for(j=0;j<q->n_r;j++) q->r[j].rule=q->rules[j];
+  if(P==0)
+  {
+#ifdef _OPENMP
+    P = omp_get_max_threads()/q->n_r;
+#endif
+    if(P<1) P=1;
+  }
+  task = malloc(q->n_r*P*sizeof(struct sat_task));
+  if( task==NULL ) error_exit("no memory for saturation search");
+
+  for(q->rounds=0; q->rounds<q->max_rounds; q->rounds++)
+  {
+    n_task=0;
+    for(j=0;j<q->n_r;j++)
+    {
+      r=q->r+j;
+      if(r->done) continue;
+      for(c=0;c<P;c++)
+      {
+        task[n_task].r=j;
+        memset(&task[n_task].p,0,sizeof(struct ts_sat_probe));
+        if(r->hi==0)
+        {
+          b = (r->lo>0)?2*r->lo:lambda0;
+          task[n_task].p.lambda = b*(1<<c);
+        }
+        else task[n_task].p.lambda = r->lo+(r->hi-r->lo)*(c+1)/(P+1);
+        n_task++;
+      }
+    }
+    if(n_task==0) break;
+
+#pragma omp parallel for schedule(dynamic,1)
+    for(c=0;c<n_task;c++)
+      sat_probe(q,q->r[task[c].r].rule,&task[c].p);
+
+    q->runs+=n_task;
+    for(c=0;c<n_task;c++) sat_add_probe(q->r+task[c].r,&task[c].p);
+    n_open=0;
+    for(j=0;j<q->n_r;j++)
+    {
+      r=q->r+j;
+      sat_bracket(r);
+      if(r->hi>0 && r->hi-r->lo <= q->tol*r->hi) r->done=1;
+      if(!r->done) n_open++;
+    }
+    if(n_open==0) {q->rounds++; break;}
+  }
+  free(task);
+} /* ts_sat_run */
+
+int sat_probe_compare(const void *a, const void *b)
+{
+  double x=((struct ts_sat_probe *)a)->lambda, y=((struct ts_sat_probe *)b)->lambda;
+  return (x<y)?-1:(x>y)?1:0;
+} /* sat_probe_compare */
+
+// throughput/latency curve per rule, saturation points with the bracket as
+// the bound
+void ts_sat_print(struct ts_sat *q, FILE *f)
+{
+  struct ts_sat_rule *r;
+  struct ts_sat_probe *p;
+  int j, c;
+
+  fprintf(f,"***** Saturation search *****\n");
+  fprintf(f,"probe configuration:");
+  for(j=0;j<q->argc;j++) fprintf(f," %s",q->argv[j]);
+  fprintf(f,"\nrounds %d, probe runs %ld, bracket tolerance %le\n",q->rounds,q->runs,q->tol);
+  if(q->cache!=NULL) fprintf(f,"cache %s: %d probes cached, %d simulated\n",q->cache_file,q->cache->hits,q->cache->misses);
+  fprintf(f,"\n");
+  for(j=0;j<q->n_r;j++)
+  {
+    r=q->r+j;
+    qsort(r->probe,r->n_probe,sizeof(struct ts_sat_probe),sat_probe_compare);
+    fprintf(f,"rule %c\n",r->rule);
+    fprintf(f,"%14s %14s %14s %14s %10s %s\n","lambda","offered","throughput","latency","time","verdict");
+    for(c=0;c<r->n_probe;c++)
+    {
+      p=r->probe+c;
+      fprintf(f,"%14e %14e %14e %14e %10ld %s\n",p->lambda,p->offered,p->throughput,p->latency,p->st,p->stable?"stable":"unstable");
+    }
+    fprintf(f,"\n");
+  }
+  fprintf(f,"saturation (lambda per node: bracket midpoint and half width, throughput of the stable end):\n");
+  for(j=0;j<q->n_r;j++)
+  {
+    r=q->r+j;
+    p=NULL;
+    for(c=0;c<r->n_probe;c++) if(r->probe[c].stable && r->probe[c].lambda==r->lo) p=r->probe+c;
+    if(r->hi==0)
+      fprintf(f,"rule %c: not found, stable up to %le\n",r->rule,r->lo);
+    else
+      fprintf(f,"rule %c: %le, half width %le (bracket %le - %le)%s, throughput %le (pkt/mtu), latency %le (mtu)\n",
+        r->rule,(r->lo+r->hi)/2,(r->hi-r->lo)/2,r->lo,r->hi,r->done?"":" not converged",
+        (p!=NULL)?p->throughput:0,(p!=NULL)?p->latency:0);
+  }
+} /* ts_sat_print */
+
+void ts_sat_destroy(struct ts_sat *q)
+{
+  int j;
+
+  for(j=0;j<q->n_r;j++) free(q->r[j].probe);
+  free(q->r);
+  for(j=0;j<q->argc;j++) free(q->argv[j]);
+  free(q->argv);
+  free(q->rules);
+  free(q->cache_file);
+  ts_cache_close(q->cache);
+  free(q);
+} /* ts_sat_destroy */
+
+// ts_sat.c end
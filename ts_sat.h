@@ -0,0 +1,58 @@
+// ts_sat.h
+// saturation search: brackets and sections lambda per switching rule with
+// probe simulations run in parallel, a probe stops once it is unstable
+
+#ifndef __TS_SAT__
+#define __TS_SAT__
+
+#include <stdio.h>
+
+#include "ts_sim.h"
+#include "ts_cache.h"
+
+struct ts_sat_probe {
+  double lambda;
+  double offered;     // generated packets per mtu
+  double throughput;  // delivered packets per mtu
+  double latency;     // mean packet latency, mtu
+  simtime st;         // simulated time, less than maxst when aborted
+  int stable;
+};
+
+struct ts_sat_rule {
+  int rule;
+  double lo, hi;      // bracket: stable at lo, unstable at hi (hi 0: not found)
+  struct ts_sat_probe * probe; // all probes of the rule
+  int n_probe, cap_probe;
+  int done;
+};
+
+struct ts_sat {
+  // param
+  char * rules;       // default abcdef
+  int n_probes;       // probes per rule and round, 0: from threads
+  double tol;         // relative bracket width
+  int max_rounds;
+  char ** argv;       // configuration of the probes
+  int argc;
+  char * cache_file;  // probe results of earlier searches
+  int cache_force;
+
+  // var
+  struct ts_sat_rule * r;
+  int n_r;
+  int rounds;
+  long runs;
+  struct ts_cache * cache;
+};
+
+struct ts_sat * ts_sat_create();
+int ts_sat_configure(struct ts_sat *q, char *a);
+int ts_sat_add_argument(struct ts_sat *q, char *a);
+void ts_sat_run(struct ts_sat *q);
+void ts_sat_print(struct ts_sat *q, FILE *f);
+void ts_sat_destroy(struct ts_sat *q);
+
+#endif
+
+// ts_sat.h end
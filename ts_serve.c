@@ -0,0 +1,474 @@
+// ts_serve.c
+// simulation service on a local UNIX socket
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdarg.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <errno.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <sys/time.h>
+
+#include "ts_serve.h"
+
+#define SERVE_STEP 0.02 // wall seconds between the cancellation points of a run
+#define SERVE_OUT_MAX (1<<20) // reply bytes a client may leave unread
+
+struct serve_worker {
+  struct ts_serve *q;
+  int w;
+};
+
+struct ts_serve * ts_serve_create()
+{
+  struct ts_serve *q = calloc(1,sizeof(struct ts_serve));
+  if( q==NULL ) error_exit("no memory for service");
+  q->lfd=-1;
+  q->wake[0]=q->wake[1]=-1;
+  return q;
+} /* ts_serve_create */
+
+// one service parameter, returns 0 for an unknown key or value
+int ts_serve_configure(struct ts_serve *q, char *a)
+{
+  if(strncmp(a,"--serve=",8)==0) {free(q->path);q->path=strdup(a+8);return q->path!=NULL && a[8]!=0;}
+  else if(strncmp(a,"--workers=",10)==0) {q->workers=atoi(a+10);return q->workers>0;}
+  else return 0;
+} /* ts_serve_configure */
+
+// a default simulation parameter of the requests, checked on a scratch
+// simulation
+int ts_serve_add_argument(struct ts_serve *q, char *a)
+{
+  struct ts_sim *s = ts_sim_create();
+  int ok = ts_sim_configure(s,a);
+
+  ts_sim_destroy(s);
+  if(!ok) return 0;
+  q->argv = realloc(q->argv,(q->argc+1)*sizeof(char *));
+  if( q->argv==NULL ) error_exit("no memory for service");
+  q->argv[q->argc] = strdup(a);
+  if( q->argv[q->argc]==NULL ) error_exit("no memory for service");
+  q->argc++;
+  return 1;
+} /* ts_serve_add_argument */
+
+// a reply line to the client, with the lock held: queued for the poll loop,
+// which sends it without blocking; a closed client is ignored
+void serve_send(struct ts_serve *q, struct serve_client *c, char *fmt, ...)
+{
+  char b[1024];
+  va_list ap;
+  int n;
+
+  va_start(ap,fmt);
+  n = vsnprintf(b,sizeof(b)-1,fmt,ap);
+  va_end(ap);
+  if(n>(int)sizeof(b)-2) n=sizeof(b)-2;
+  b[n++]='\n';
+  if(c->fd<0 || c->overrun) return;
+  if(c->out_len+n>SERVE_OUT_MAX) c->overrun=1;
+  else
+  {
+    if(c->out_len+n>c->out_cap)
+    {
+      c->out_cap = 2*c->out_cap+n;
+      c->out = realloc(c->out,c->out_cap);
+      if( c->out==NULL ) error_exit("no memory for replies");
+    }
+    memcpy(c->out+c->out_len,b,n);
+    c->out_len+=n;
+  }
+  if(write(q->wake[1],"",1)<0) {}
+} /* serve_send */
+
+// with the lock held: sends what the socket takes of the pending replies,
+// returns 0 when the client is to be disconnected
+int serve_flush(struct serve_client *c)
+{
+  int n;
+
+  if(c->overrun) return 0;
+  if(c->out_len==0) return 1;
+  n = send(c->fd,c->out,c->out_len,MSG_NOSIGNAL|MSG_DONTWAIT);
+  if(n<0) return errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR;
+  c->out_len-=n;
+  memmove(c->out,c->out+n,c->out_len);
+  return 1;
+} /* serve_flush */
+
+// with the lock held: the last reference closes the connection
+void client_release(struct serve_client *c)
+{
+  if(--c->refs > 0) return;
+  if(c->fd>=0) close(c->fd);
+  free(c->out);
+  free(c);
+} /* client_release */
+
+double serve_time()
+{
+  struct timeval tv;
+  gettimeofday(&tv,NULL);
+  return tv.tv_sec+tv.tv_usec*1e-6;
+} /* serve_time */
+
+// one request: the defaults and options of the line configure a simulation
+// taking over the storage of the previous one of the worker, run in steps
+// of about SERVE_STEP wall time to see a cancellation; an error ends the
+// request only
+void serve_job(struct ts_serve *q, struct serve_job *j, struct ts_sim **last)
+{
+  struct ts_sim * volatile s = NULL;
+  struct ts_stat t;
+  jmp_buf jb;
+  char *a, *save, msg[256];
+  simtime dt, until;
+  int k, more;
+  double w, wall = serve_time();
+
+  if(setjmp(jb))
+  {
+    ts_error_jmp = NULL;
+    pthread_mutex_lock(&q->mu);
+    serve_send(q,j->c,"error %ld %s",j->id,ts_error_msg);
+    q->failed++;
+    pthread_mutex_unlock(&q->mu);
+    if(s!=NULL) ts_sim_destroy(s);
+    return;
+  }
+  ts_error_jmp = &jb;
+  s = ts_sim_create();
+  for(k=0;k<q->argc;k++) ts_sim_configure(s,q->argv[k]);
+  for(a=strtok_r(j->line," \t",&save); a!=NULL; a=strtok_r(NULL," \t",&save))
+  {
+    if(ts_sim_configure(s,a)) continue;
+    snprintf(msg,sizeof(msg),"bad option %s",a);
+    error_exit(msg);
+  }
+  if(s->model!='s' || s->stats_interval>0 || s->perf || s->dbg>0)
+    error_exit("the service simulates (--model=sim) without time series, counters or debug output");
+  ts_sim_reuse(s,*last);
+  *last = NULL;
+  ts_sim_init(s);
+  dt = s->cht;
+  for(until=dt, more=1; more && !j->cancel; until+=dt)
+  {
+    w = serve_time();
+    more = ts_sim_step(s,until);
+    w = serve_time()-w;
+    if(w<SERVE_STEP/2) dt*=2;
+    else if(w>2*SERVE_STEP && dt>1) dt/=2;
+  }
+  ts_error_jmp = NULL;
+
+  ts_sim_stats(s,&t);
+  pthread_mutex_lock(&q->mu);
+  if(j->cancel)
+  {
+    serve_send(q,j->c,"cancelled %ld st=%ld",j->id,t.st);
+    q->cancelled++;
+  }
+  else
+  {
+    serve_send(q,j->c,"result %ld st=%ld generated=%ld delivered=%ld queued=%ld dropped=%ld undeliverable=%ld "
+      "throughput=%.9e latency=%.9e hops=%.9e wall=%.6f",j->id,t.st,t.generated_packets,t.delevered_packets,
+      t.queued_packets,t.dropped_packets,t.undeliverable_packets,t.delevered_packets/(double)t.st,
+      (t.delevered_packets>0)?t.sum_of_latency/t.delevered_packets:0,
+      (t.delevered_packets>0)?t.sum_of_hops/t.delevered_packets:0,serve_time()-wall);
+    q->done++;
+  }
+  pthread_mutex_unlock(&q->mu);
+  *last = s;
+} /* serve_job */
+
+void * serve_worker(void *arg)
+{
+  struct serve_worker *sw = arg;
+  struct ts_serve *q = sw->q;
+  struct serve_job *j;
+  struct ts_sim *last = NULL;
+
+  for(;;)
+  {
+    pthread_mutex_lock(&q->mu);
+    while(!q->stop && q->head==NULL) pthread_cond_wait(&q->cv,&q->mu);
+    if(q->stop)
+    {
+      pthread_mutex_unlock(&q->mu);
+      break;
+    }
+    j = q->head;
+    q->head = j->next;
+    if(q->head==NULL) q->tail=NULL;
+    q->queued--;
+    q->running[sw->w] = j;
+    pthread_mutex_unlock(&q->mu);
+
+    serve_job(q,j,&last);
+
+    pthread_mutex_lock(&q->mu);
+    q->running[sw->w] = NULL;
+    client_release(j->c);
+    pthread_mutex_unlock(&q->mu);
+    free(j->line);
+    free(j);
+  }
+  if(last!=NULL) ts_sim_destroy(last);
+  return NULL;
+} /* serve_worker */
+
+// with the lock held: a queued job is dropped, a running one stops at its
+// next checkpoint; returns 0 for no such job
+int serve_cancel(struct ts_serve *q, long id)
+{
+  struct serve_job *j, *p=NULL;
+  int w;
+
+  for(j=q->head; j!=NULL; p=j, j=j->next)
+  {
+    if(id>=0 && j->id!=id) continue;
+    if(p==NULL) q->head=j->next;
+    else p->next=j->next;
+    if(q->tail==j) q->tail=p;
+    q->queued--;
+    q->cancelled++;
+    serve_send(q,j->c,"cancelled %ld st=0",j->id);
+    client_release(j->c);
+    free(j->line);
+    free(j);
+    return 1;
+  }
+  for(w=0;w<q->workers;w++)
+    if(q->running[w]!=NULL && (id<0 || q->running[w]->id==id) && !q->running[w]->cancel)
+    {
+      q->running[w]->cancel=1;
+      return 1;
+    }
+  return 0;
+} /* serve_cancel */
+
+// one line of a client: options of a simulation, or status, cancel id,
+// shutdown
+void serve_line(struct ts_serve *q, struct serve_client *c, char *line)
+{
+  struct serve_job *j;
+  int w, n;
+  long id;
+
+  while(*line==' ' || *line=='\t') line++;
+  n = strlen(line);
+  while(n>0 && (line[n-1]=='\r' || line[n-1]==' ' || line[n-1]=='\t')) line[--n]=0;
+  if(n==0 || line[0]=='#') return;
+
+  pthread_mutex_lock(&q->mu);
+  if(strcmp(line,"status")==0)
+  {
+    for(w=0,n=0;w<q->workers;w++) if(q->running[w]!=NULL) n++;
+    serve_send(q,c,"status queued=%d running=%d done=%ld failed=%ld cancelled=%ld workers=%d",
+      q->queued,n,q->done,q->failed,q->cancelled,q->workers);
+  }
+  else if(strncmp(line,"cancel ",7)==0)
+  {
+    id = atol(line+7);
+    if(id>0 && serve_cancel(q,id)) serve_send(q,c,"ok cancel %ld",id);
+    else serve_send(q,c,"error %ld no such job",id);
+  }
+  else if(strcmp(line,"shutdown")==0)
+  {
+    while(serve_cancel(q,-1));
+    q->stop=1;
+    pthread_cond_broadcast(&q->cv);
+    serve_send(q,c,"ok shutdown");
+  }
+  else if(strncmp(line,"--",2)==0)
+  {
+    j = calloc(1,sizeof(struct serve_job));
+    if( j==NULL || (j->line = strdup(line))==NULL ) error_exit("no memory for requests");
+    j->id = ++q->next_id;
+    j->c = c;
+    c->refs++;
+    if(q->tail==NULL) q->head=j;
+    else q->tail->next=j;
+    q->tail=j;
+    q->queued++;
+    serve_send(q,c,"queued %ld depth=%d",j->id,q->queued);
+    pthread_cond_signal(&q->cv);
+  }
+  else serve_send(q,c,"error 0 unknown request");
+  pthread_mutex_unlock(&q->mu);
+} /* serve_line */
+
+// reads the requests of the client, returns 0 when it disconnected
+int serve_read(struct ts_serve *q, struct serve_client *c)
+{
+  char *e, *b;
+  int n;
+
+  n = read(c->fd,c->buf+c->len,sizeof(c->buf)-1-c->len);
+  if(n<0) return errno==EAGAIN || errno==EWOULDBLOCK || errno==EINTR;
+  if(n==0) return 0;
+  c->len+=n;
+  c->buf[c->len]=0;
+  b=c->buf;
+  while( (e = strchr(b,'\n')) != NULL )
+  {
+    *e=0;
+    serve_line(q,c,b);
+    b=e+1;
+  }
+  c->len -= b-c->buf;
+  memmove(c->buf,b,c->len);
+  if(c->len==sizeof(c->buf)-1)
+  {
+    pthread_mutex_lock(&q->mu);
+    serve_send(q,c,"error 0 request line too long");
+    pthread_mutex_unlock(&q->mu);
+    c->len=0;
+  }
+  return 1;
+} /* serve_read */
+
+// accepts clients, reads their requests and sends the replies until
+// shutdown, the sockets do not block; the jobs of a client that disconnects,
+// or leaves more than SERVE_OUT_MAX reply bytes unread, are cancelled
+void ts_serve_run(struct ts_serve *q)
+{
+  struct sockaddr_un addr;
+  struct serve_worker *sw;
+  struct serve_client **cl=NULL, *c;
+  struct pollfd *pfd=NULL;
+  struct serve_job *j;
+  pthread_t *tid;
+  char b[64];
+  int n_cl=0, cap_cl=0, w, k, m, live;
+  double t;
+
+  if(q->path==NULL) error_exit("no socket path");
+  if(strlen(q->path)>=sizeof(addr.sun_path)) error_exit("socket path too long");
+  if(q->workers==0) q->workers = sysconf(_SC_NPROCESSORS_ONLN);
+  if(q->workers<1) q->workers=1;
+  q->lfd = socket(AF_UNIX,SOCK_STREAM,0);
+  if(q->lfd<0) error_exit("cannot create socket");
+  memset(&addr,0,sizeof(addr));
+  addr.sun_family = AF_UNIX;
+  strcpy(addr.sun_path,q->path);
+  unlink(q->path);
+  if(bind(q->lfd,(struct sockaddr *)&addr,sizeof(addr))<0 || listen(q->lfd,64)<0)
+    error_exit("cannot listen on the socket");
+  if(pipe(q->wake)<0) error_exit("cannot create the wake pipe");
+  fcntl(q->wake[0],F_SETFL,O_NONBLOCK);
+  fcntl(q->wake[1],F_SETFL,O_NONBLOCK);
+
+  pthread_mutex_init(&q->mu,NULL);
+  pthread_cond_init(&q->cv,NULL);
+  q->running = calloc(q->workers,sizeof(struct serve_job *));
+  sw = malloc(q->workers*sizeof(struct serve_worker));
+  tid = malloc(q->workers*sizeof(pthread_t));
+  if( q->running==NULL || sw==NULL || tid==NULL ) error_exit("no memory for workers");
+  for(w=0;w<q->workers;w++)
+  {
+    sw[w].q=q;
+    sw[w].w=w;
+    if(pthread_create(tid+w,NULL,serve_worker,sw+w)!=0) error_exit("cannot start workers");
+  }
+  fprintf(stderr,"ts: serving %s with %d workers\n",q->path,q->workers);
+
+  while(!q->stop)
+  {
+    if(n_cl+1>cap_cl)
+    {
+      cap_cl = 2*cap_cl+8;
+      cl = realloc(cl,cap_cl*sizeof(struct serve_client *));
+      pfd = realloc(pfd,(cap_cl+2)*sizeof(struct pollfd));
+      if( cl==NULL || pfd==NULL ) error_exit("no memory for clients");
+    }
+    pfd[0].fd=q->lfd;
+    pfd[0].events=POLLIN;
+    pfd[1].fd=q->wake[0];
+    pfd[1].events=POLLIN;
+    pthread_mutex_lock(&q->mu);
+    for(k=0;k<n_cl;k++)
+    {
+      pfd[k+2].fd=cl[k]->fd;
+      pfd[k+2].events=POLLIN|((cl[k]->out_len>0)?POLLOUT:0);
+    }
+    pthread_mutex_unlock(&q->mu);
+    if(poll(pfd,n_cl+2,-1)<0) continue;
+    if(pfd[1].revents & POLLIN) while(read(q->wake[0],b,sizeof(b))>0);
+    for(k=n_cl-1;k>=0;k--)
+    {
+      c=cl[k];
+      live = !(pfd[k+2].revents & (POLLIN|POLLHUP|POLLERR)) || serve_read(q,c);
+      pthread_mutex_lock(&q->mu);
+      if(live) live=serve_flush(c);
+      pthread_mutex_unlock(&q->mu);
+      if(live) continue;
+      // disconnected: its jobs are cancelled, replies go nowhere
+      cl[k]=cl[--n_cl];
+      pthread_mutex_lock(&q->mu);
+      close(c->fd);
+      c->fd=-1;
+      do
+      {
+        for(j=q->head;j!=NULL && j->c!=c;j=j->next);
+        if(j!=NULL) serve_cancel(q,j->id);
+      } while(j!=NULL);
+      for(w=0;w<q->workers;w++) if(q->running[w]!=NULL && q->running[w]->c==c) q->running[w]->cancel=1;
+      client_release(c);
+      pthread_mutex_unlock(&q->mu);
+    }
+    if(pfd[0].revents & POLLIN)
+    {
+      w = accept(q->lfd,NULL,NULL);
+      if(w<0) continue;
+      c = calloc(1,sizeof(struct serve_client));
+      if( c==NULL ) error_exit("no memory for clients");
+      fcntl(w,F_SETFL,O_NONBLOCK);
+      c->fd=w;
+      c->refs=1;
+      cl[n_cl++]=c;
+    }
+  }
+
+  for(w=0;w<q->workers;w++) pthread_join(tid[w],NULL);
+  // the last replies, for at most a second
+  for(t=serve_time()+1; serve_time()<t; )
+  {
+    for(k=0,m=0;k<n_cl;k++)
+    {
+      pfd[k].fd=(cl[k]->out_len>0 && !cl[k]->overrun)?cl[k]->fd:-1;
+      pfd[k].events=POLLOUT;
+      if(pfd[k].fd>=0) m++;
+    }
+    if(m==0 || poll(pfd,n_cl,100)<0) break;
+    for(k=0;k<n_cl;k++)
+      if((pfd[k].revents & (POLLOUT|POLLHUP|POLLERR)) && !serve_flush(cl[k])) cl[k]->overrun=1;
+  }
+  for(k=0;k<n_cl;k++) client_release(cl[k]);
+  free(cl);
+  free(pfd);
+  free(sw);
+  free(tid);
+  close(q->lfd);
+  close(q->wake[0]);
+  close(q->wake[1]);
+  unlink(q->path);
+} /* ts_serve_run */
+
+void ts_serve_destroy(struct ts_serve *q)
+{
+  int j;
+
+  for(j=0;j<q->argc;j++) free(q->argv[j]);
+  free(q->argv);
+  free(q->path);
+  free(q->running);
+  free(q);
+} /* ts_serve_destroy */
+
+// ts_serve.c end
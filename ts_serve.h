@@ -0,0 +1,58 @@
+// ts_serve.h
+// simulation service: a daemon on a local UNIX socket takes one request per
+// line and runs the simulations on a pool of worker threads, each worker
+// reusing the storage of its previous simulation
+
+#ifndef __TS_SERVE__
+#define __TS_SERVE__
+
+#include <pthread.h>
+
+#include "ts_sim.h"
+
+struct serve_client {
+  int fd;
+  int refs;           // the connection and its jobs not yet answered
+  char buf[4096];     // partial request line
+  int len;
+  char * out;         // replies not yet sent
+  int out_len, out_cap;
+  int overrun;        // more than SERVE_OUT_MAX bytes pending: disconnected
+};
+
+struct serve_job {
+  long id;
+  char * line;        // options of the request
+  struct serve_client * c;
+  volatile int cancel;
+  struct serve_job * next;
+};
+
+struct ts_serve {
+  // param
+  char * path;        // socket
+  int workers;        // 0: processors
+  char ** argv;       // defaults of the requests
+  int argc;
+
+  // var
+  int lfd;
+  int wake[2];        // pipe: replies for the poll loop to send
+  pthread_mutex_t mu; // queue, running jobs, counters and client replies
+  pthread_cond_t cv;
+  struct serve_job *head, *tail; // queued
+  struct serve_job ** running; // per worker
+  int queued;
+  long next_id, done, failed, cancelled;
+  int stop;
+};
+
+struct ts_serve * ts_serve_create();
+int ts_serve_configure(struct ts_serve *q, char *a);
+int ts_serve_add_argument(struct ts_serve *q, char *a);
+void ts_serve_run(struct ts_serve *q);
+void ts_serve_destroy(struct ts_serve *q);
+
+#endif
+
+// ts_serve.h end
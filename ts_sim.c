@@ -0,0 +1,3461 @@
+// torus simulation context: all state of a simulation in struct ts_sim,
+// independent simulations can run concurrently on different threads
+// gcc -c ts_sim.c ts_stream.c
+// ar rcs libts.a ts_sim.o ts_stream.o al2.o
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <limits.h>
+#include <sys/time.h>
+
+#ifdef TS_MPI
+#include <mpi.h>
+#endif
+
+#include "ts_sim.h"
+#include "ts_sim_int.h"
+#include "ts_cache.h"
+
+#define INJ_BATCH 4096 // expected number of injections generated per window
+#define POOL_SLAB 256 // list elements allocated at once
+#define HYBRID_RHO 0.5 // hybrid model simulates above this channel utilisation
+#define MPI_PKT_LONGS 9 // arrival time, node, send time, hops, source, destination, misroutes, back port, size
+#define SW_LOST -2 // sw_pkt: packet cannot be delivered
+#define DETOUR_END 0xff // end of the detour ports of a port
+#ifndef TS_VERSION // cache keys: the Makefile passes a checksum of the sources
+#define TS_VERSION __DATE__ " " __TIME__
+#endif
+#define REC_BUF (1<<20) // time series writer buffer, bytes
+
+#if defined(__GNUC__) && defined(__x86_64__) && !defined(__clang__)
+// batch kernels: an avx2 clone, vectorised at -O2 (the comparisons of the
+// loop must not trap to be if-converted)
+#define SIMD_CLONES __attribute__((target_clones("avx2","default"),optimize("tree-vectorize","vect-cost-model=dynamic","no-trapping-math")))
+#else
+#define SIMD_CLONES
+#endif
+
+// abstract list content specific routines ///
+
+int event_compare_content(void * x1, void *x2)
+{
+  struct event *e1=(struct event *)x1;
+  struct event *e2=(struct event *)x2;
+  if((e1->at) < (e2->at)) return -1;
+  else if((e1->at) > (e2->at)) return 1;
+  else return 0;
+} /* event_compare_content */
+
+// queue extraction for the free port np: the key starts with np
+struct port_key {
+  int np;
+  struct ts_sim *s;
+};
+
+int packet_find_content(void *x1, void *x2)
+{
+  int * pnp = (int *)x1;
+  struct packet *p=(struct packet *)x2;
+  int np=*pnp, j;
+
+  if(p->dports!=0) return (p->dports>>np)&1;
+  j=PORT_DIMENSION(np);
+
+  if((p->da[j] != 0) && (SIGN(p->da[j]) == PORT_DIRECTION(np)) ) return 1;
+  else return 0;
+} /* packet_find_content */
+
+// generalised neighbourhoods: np among the productive ports of the packet
+int packet_find_nbh(void *x1, void *x2)
+{
+  struct port_key *key = (struct port_key *)x1;
+  struct packet *p=(struct packet *)x2;
+  struct ts_sim *s=key->s;
+  int c;
+
+  for(c=s->cand_start[p->dix];c<s->cand_start[p->dix+1];c++)
+    if(s->cand[c]==key->np) return 1;
+  return 0;
+} /* packet_find_nbh */
+
+void print_events(struct ts_sim *s)
+{
+  struct l2 *el2=s->eq;
+  struct event *e;
+  int j;
+
+  if(el2==NULL) return;
+  do
+  {
+    e=(struct event *)el2->content;
+    printf("event\n");
+    printf("at=%ld, np=%d\n",e->at,e->np);
+    for(j=0;j<s->d;j++) printf("%d ",e->i[j]);
+    printf("\n");
+    el2=el2->next;
+  } while(el2!=s->eq);
+  printf("\n");
+} /* print_events */
+
+/////////////////////////////////////////////
+
+struct ts_sim * ts_sim_create()
+{
+  struct ts_sim *s = calloc(1,sizeof(struct ts_sim));
+  if( s==NULL ) error_exit("no memory for simulation");
+  s->d=3;
+  s->k=4;
+  s->rule='a';
+  s->lambda=0.01;
+  s->cht=100;
+  s->bl=10000;
+  s->max_st=1000000;
+  s->engine='e';
+  s->model='s';
+  s->nranks=1;
+  s->stats_format='c';
+  s->max_mis=8;
+  s->coll_reps=1;
+  s->size_kind='f';
+  s->size_a=1;
+  s->nbh='n';
+  s->radius=1;
+  s->arb='f';
+  s->src_kind='p';
+  return s;
+} /* ts_sim_create */
+
+// shortest coordinate differences, looked up by id[j]-is[j]
+void adr_diff(struct ts_sim *s, int *id,int *is, int *di)
+{
+  int j;
+  for(j=0;j<s->d;j++) di[j]=s->dtab_c[j][id[j]-is[j]];
+} /* adr_diff */
+
+// a torus dimension takes the shorter direction (negative on a tie), a mesh
+// dimension the difference itself
+void adr_diff_table(struct ts_sim *s)
+{
+  int j, x, n=0, *t;
+
+  for(j=0;j<s->d;j++) n+=2*s->kk[j]-1;
+  s->dtab = t = malloc(n*sizeof(int));
+  s->dtab_c = malloc(s->d*sizeof(int *));
+  if( t==NULL || s->dtab_c==NULL ) error_exit("no memory for distance tables");
+  for(j=0;j<s->d;j++)
+  {
+    s->dtab_c[j] = t+s->kk[j]-1;
+    for(x=1-s->kk[j];x<s->kk[j];x++)
+    {
+      if(!s->wrap[j] || ABS(x)<s->kk[j]-ABS(x)) s->dtab_c[j][x]=x;
+      else s->dtab_c[j][x]=-SIGN(x)*(s->kk[j]-ABS(x));
+    }
+    t+=2*s->kk[j]-1;
+  }
+} /* adr_diff_table */
+
+static char *coll_name[] = {"ring","rd","torus","alltoall","bcast","halo",NULL};
+static char coll_kind[] = "rdtabh";
+
+// --coll=ring|rd|torus|alltoall|bcast|halo
+int coll_spec(struct ts_sim *s, char *a)
+{
+  int c;
+
+  for(c=0;coll_name[c]!=NULL;c++)
+    if(strcmp(a,coll_name[c])==0) {s->coll=coll_kind[c];return 1;}
+  return 0;
+} /* coll_spec */
+
+void coll_statistics(struct ts_sim *s, FILE *f)
+{
+  int r, done=s->coll_reps-s->coll_left;
+  simtime dt, dmin=LONG_MAX, dmax=0;
+  double sum=0;
+
+  fprintf(f,"collective %s: %d steps, %d of %d repetitions completed\n",
+    coll_name[strchr(coll_kind,s->coll)-coll_kind],s->coll_steps,done,s->coll_reps);
+  for(r=0;r<done;r++)
+  {
+    dt=s->crep_time[r]-s->crep_start[r];
+    sum+=dt;
+    if(dt<dmin) dmin=dt;
+    if(dt>dmax) dmax=dt;
+    if(s->coll_reps<=10) fprintf(f,"repetition %d: started at %ld, completed at %ld, %ld (mtu)\n",
+      r+1,s->crep_start[r],s->crep_time[r],dt);
+  }
+  if(done>0) fprintf(f,"completion time: %le (mtu) average, %ld min, %ld max\n",sum/done,dmin,dmax);
+} /* coll_statistics */
+
+static char *class_pattern[] = {"uniform","neighbour","transpose","complement","hotspot",NULL};
+static char class_kind[] = "untch";
+static char *arb_name[] = {"oldest packet","strict priority","weighted round robin"};
+
+// --class=lambda[,size[,pattern[,weight]]], one key per class in priority order
+int class_spec(struct ts_sim *s, char *a)
+{
+  struct ts_class *c=s->cls+s->n_class;
+  char pat[16]="uniform";
+  int m, j;
+
+  if(s->n_class==TS_MAX_CLASS) return 0;
+  c->size=0;
+  c->weight=1;
+  m=sscanf(a,"%lf,%d,%15[a-z],%d",&c->lambda,&c->size,pat,&c->weight);
+  if(m<1 || c->lambda<0 || c->size<0 || c->weight<1) return 0;
+  for(j=0;class_pattern[j]!=NULL && strcmp(pat,class_pattern[j])!=0;j++);
+  if(class_pattern[j]==NULL) return 0;
+  c->pattern=class_kind[j];
+  s->n_class++;
+  return 1;
+} /* class_spec */
+
+// every metric of the statistics per class, with the mean latency
+void class_statistics(struct ts_sim *s, FILE *f)
+{
+  struct ts_stat *t;
+  struct ts_class *c;
+  int j;
+
+  fprintf(f,"\n***** Traffic Classes *****\n");
+  fprintf(f,"arbitration: %s\n",arb_name[strchr("fsw",s->arb)-"fsw"]);
+  for(j=0;j<s->n_class;j++)
+  {
+    t=s->cstat+j;
+    c=s->cls+j;
+    fprintf(f,"\nclass %d: lambda %le, %s destinations",j,c->lambda,class_pattern[strchr(class_kind,c->pattern)-class_kind]);
+    if(c->size>0) fprintf(f,", size %d (bytes)",c->size);
+    if(s->arb=='w') fprintf(f,", weight %d",c->weight);
+    fprintf(f,"\n");
+    fprintf(f,"generated packets: %ld\n",t->generated_packets);
+    fprintf(f,"delevered packets: %ld\n",t->delevered_packets);
+    fprintf(f,"queued packets: %ld\n",t->queued_packets);
+    fprintf(f,"dropped packets: %ld (%le %%)\n",t->dropped_packets,(double)t->dropped_packets/t->delevered_packets*100.0);
+    fprintf(f,"performanse: %le (pkt/mtu)\n",((double)t->delevered_packets)/s->st);
+    fprintf(f,"load: %le (%%)\n",t->chan_work_time/(s->st*s->n_chan)*100.0);
+    fprintf(f,"average hops per packet: %le\n",t->sum_of_hops/t->delevered_packets);
+    fprintf(f,"average packet channel time: %e (mtu)\n",t->sum_of_packet_avg_chan_time/t->delevered_packets);
+    fprintf(f,"average latency: %le (mtu)\n",t->sum_of_latency/t->delevered_packets);
+    fprintf(f,"delivered bytes: %.0f, %le (bytes/mtu)\n",t->delivered_bytes,t->delivered_bytes/s->st);
+    if(s->faults!=NULL)
+      fprintf(f,"undeliverable packets: %ld (%le %%)\n",t->undeliverable_packets,(double)t->undeliverable_packets/t->generated_packets*100.0);
+  }
+} /* class_statistics */
+
+// --source=poisson, onoff:burst,duty, mmpp:burst,duty,ratio,
+// closed:window[,think], reqrep:window[,think]
+int src_spec(struct ts_sim *s, char *a)
+{
+  int c;
+
+  s->think=0;
+  if(strcmp(a,"poisson")==0) {s->src_kind='p';return 1;}
+  else if(strncmp(a,"onoff:",6)==0)
+  {
+    s->src_kind='o';
+    c=sscanf(a+6,"%lf,%lf",&s->src_burst,&s->src_duty);
+    return c==2 && s->src_burst>0 && s->src_duty>0 && s->src_duty<=1;
+  }
+  else if(strncmp(a,"mmpp:",5)==0)
+  {
+    s->src_kind='m';
+    c=sscanf(a+5,"%lf,%lf,%lf",&s->src_burst,&s->src_duty,&s->src_ratio);
+    return c==3 && s->src_burst>0 && s->src_duty>0 && s->src_duty<=1 && s->src_ratio>=1;
+  }
+  else if(strncmp(a,"closed:",7)==0 || strncmp(a,"reqrep:",7)==0)
+  {
+    s->src_kind=(a[0]=='c')?'c':'r';
+    c=sscanf(a+7,"%d,%lf",&s->window,&s->think);
+    return c>=1 && s->window>0 && s->think>=0;
+  }
+  return 0;
+} /* src_spec */
+
+// offered and achieved load, one-way and round-trip latency
+void src_statistics(struct ts_sim *s, FILE *f)
+{
+  struct ts_stat *t = &s->stat;
+
+  fprintf(f,"offered load: %le, achieved throughput: %le (pkt/mtu per node)\n",
+    (double)t->generated_packets/s->st/s->n_nodes,(double)t->delevered_packets/s->st/s->n_nodes);
+  fprintf(f,"one-way latency: %le (mtu)\n",t->sum_of_latency/t->delevered_packets);
+  if(s->outstanding!=NULL)
+    fprintf(f,"round trips: %ld, %le (per mtu), round-trip latency: %le (mtu)\n",
+      t->completed_requests,(double)t->completed_requests/s->st,t->sum_of_rtt/t->completed_requests);
+} /* src_statistics */
+
+// --size=n (fixed), uniform:a,b, bimodal:a,b,p (a with probability p),
+// exp:mean
+int size_spec(struct ts_sim *s, char *a)
+{
+  int c;
+
+  s->size_b=s->size_p=0;
+  if(strncmp(a,"uniform:",8)==0)
+  {
+    s->size_kind='u';
+    c=sscanf(a+8,"%lf,%lf",&s->size_a,&s->size_b);
+    return c==2 && s->size_a>=1 && s->size_b>=s->size_a;
+  }
+  else if(strncmp(a,"bimodal:",8)==0)
+  {
+    s->size_kind='b';
+    c=sscanf(a+8,"%lf,%lf,%lf",&s->size_a,&s->size_b,&s->size_p);
+    return c==3 && s->size_a>=1 && s->size_b>=1 && s->size_p>=0 && s->size_p<=1;
+  }
+  else if(strncmp(a,"exp:",4)==0)
+  {
+    s->size_kind='e';
+    s->size_a=atof(a+4);
+    return s->size_a>=1;
+  }
+  s->size_kind='f';
+  s->size_a=atoi(a);
+  return s->size_a>=1;
+} /* size_spec */
+
+int pkt_size(struct ts_sim *s)
+{
+  double u;
+
+  if(s->size_kind=='f') return s->size_a;
+  u = rand_r(&s->rng_size) / (RAND_MAX + 1.0);
+  switch(s->size_kind)
+  {
+  case 'u': return s->size_a+(int)(u*(s->size_b-s->size_a+1));
+  case 'b': return (u<s->size_p)?s->size_a:s->size_b;
+  default: // 'e': 1 + geometric of mean size_a-1
+    if(s->size_a<=1) return 1;
+    return 1+(int)(log(1-u)/log(1-1/s->size_a));
+  }
+} /* pkt_size */
+
+// least packet size of --size, or of the classes
+int size_min(struct ts_sim *s)
+{
+  int c, m=INT_MAX, g=s->size_a;
+
+  if(s->size_kind=='b' && s->size_b<g) g=s->size_b;
+  if(s->size_kind=='e') g=1;
+  if(s->n_class==0) return g;
+  for(c=0;c<s->n_class;c++)
+  {
+    if(s->cls[c].size==0 && g<m) m=g;
+    else if(s->cls[c].size>0 && s->cls[c].size<m) m=s->cls[c].size;
+  }
+  return m;
+} /* size_min */
+
+// a value for all dimensions or a list v0,v1,... of d values
+void dims_values(char *a, double *v, int d, char *name)
+{
+  int j, c=0;
+  char *e, m[128];
+
+  do
+  {
+    if(c<d) v[c]=strtod(a,&e);
+    else strtod(a,&e);
+    if(e==a || v[(c<d)?c:0]<0) break;
+    c++;
+    a=e+1;
+  } while(*e==',');
+  if(e==a || *e!=0 || (c!=1 && c!=d))
+  {
+    snprintf(m,sizeof(m),"%s: one value or one per dimension",name);
+    error_exit(m);
+  }
+  for(j=c;j<d;j++) v[j]=v[0];
+} /* dims_values */
+
+// --k=size or --k=k0,k1,...
+int topo_sizes(struct ts_sim *s, char *a)
+{
+  int c;
+  char *e;
+
+  s->n_ksz=0;
+  do
+  {
+    if((s->n_ksz & (s->n_ksz-1))==0)
+    {
+      s->ksz=realloc(s->ksz,(s->n_ksz==0?1:2*s->n_ksz)*sizeof(int));
+      if( s->ksz==NULL ) error_exit("no memory for sizes");
+    }
+    c=strtol(a,&e,10);
+    if(e==a || c<2) return 0;
+    s->ksz[s->n_ksz++]=c;
+    a=e+1;
+  } while(*e==',');
+  if(*e!=0) return 0;
+  s->k=s->ksz[0];
+  return 1;
+} /* topo_sizes */
+
+// channel latency and serialisation per dimension: a packet of size bytes
+// occupies a channel of dimension j for size*tpb[j], arrives lat[j] later;
+// by default a byte takes cht without latency
+void chan_times(struct ts_sim *s)
+{
+  int j, d=s->d;
+  double v[d];
+  simtime t;
+
+  free(s->lat); free(s->tpb);
+  s->lat=malloc(d*sizeof(simtime));
+  s->tpb=malloc(d*sizeof(double));
+  if( s->lat==NULL || s->tpb==NULL ) error_exit("no memory for channels");
+  for(j=0;j<d;j++) { s->lat[j]=0; s->tpb[j]=s->cht; }
+  if(s->lat_spec!=NULL)
+  {
+    dims_values(s->lat_spec,v,d,"--lat");
+    for(j=0;j<d;j++) s->lat[j]=v[j];
+  }
+  if(s->bw_spec!=NULL)
+  {
+    dims_values(s->bw_spec,v,d,"--bw");
+    for(j=0;j<d;j++)
+    {
+      if(v[j]<=0) error_exit("--bw: bandwidth must be positive");
+      s->tpb[j]=1/v[j];
+    }
+  }
+  s->lookahead=LONG_MAX;
+  for(j=0;j<d;j++)
+  {
+    t=size_min(s)*s->tpb[j]+0.5;
+    if(t<1) t=1;
+    if(t+s->lat[j]<s->lookahead) s->lookahead=t+s->lat[j];
+  }
+} /* chan_times */
+
+// packet serialisation time in port np
+simtime chan_time(struct ts_sim *s, struct packet *p, int np)
+{
+  simtime t=p->size*s->tpb[s->pdim[np]]+0.5;
+  return (t<1)?1:t;
+} /* chan_time */
+
+// channels with one time per packet: fixed size 1, no latency, no bandwidth
+int chan_uniform(struct ts_sim *s)
+{
+  return s->lat_spec==NULL && s->bw_spec==NULL && s->size_kind=='f' && s->size_a==1 && s->n_class==0;
+} /* chan_uniform */
+
+// hops covering the shortest differences da: a von Neumann step changes the
+// coordinates by at most radius in sum, a Moore step each of them by radius
+int nbh_dist(struct ts_sim *s, int *da)
+{
+  int j, m=0;
+
+  for(j=0;j<s->d;j++)
+  {
+    if(s->nbh=='m') { if(ABS(da[j])>m) m=ABS(da[j]); }
+    else m+=ABS(da[j]);
+  }
+  return (m+s->radius-1)/s->radius;
+} /* nbh_dist */
+
+// index of da in the candidate table, per dimension radix 2k-1
+int nbh_index(struct ts_sim *s, int *da)
+{
+  int j, x=0;
+  for(j=0;j<s->d;j++) x=x*(2*s->kk[j]-1)+da[j]+s->kk[j]-1;
+  return x;
+} /* nbh_index */
+
+// ports: offsets o!=0 within the radius, the pair -o, +o at 2t, 2t+1 with o
+// by increasing length, first nonzero coordinate positive, decreasing
+// lexicographically, so that radius 1 von Neumann ports are 2m+(r==1) of
+// dimension m; a port takes the channel times of its longest coordinate
+void nbh_ports(struct ts_sim *s)
+{
+  int j, c, t, m, n=1, d=s->d, r=s->radius, o[d], *po;
+
+  for(j=0;j<d;j++) n*=2*r+1;
+  s->n_ports=0;
+  s->poff=po=malloc(n*d*sizeof(int));
+  s->pdim=malloc(n*sizeof(int));
+  if( po==NULL || s->pdim==NULL ) error_exit("no memory for ports");
+  for(m=1;m<=d*r;m++) // length
+    for(c=n-1;c>=0;c--)
+    {
+      for(j=d-1,t=c;j>=0;j--) { o[j]=t%(2*r+1)-r; t/=2*r+1; }
+      for(j=0;j<d && o[j]==0;j++);
+      if(j==d || o[j]<0) continue;
+      for(j=t=0;j<d;j++) t+=ABS(o[j]);
+      if(t!=m) continue;
+      for(j=t=0;j<d;j++) if(ABS(o[j])>t) t=ABS(o[j]);
+      if(s->nbh!='m' && m>r) continue;
+      for(j=0;j<d;j++) { po[s->n_ports*d+j]=-o[j]; po[(s->n_ports+1)*d+j]=o[j]; }
+      for(j=0;ABS(o[j])!=t;j++);
+      s->pdim[s->n_ports]=s->pdim[s->n_ports+1]=j;
+      s->n_ports+=2;
+    }
+} /* nbh_ports */
+
+// productive ports (one hop closer) of every difference, most progress first:
+// the weight of a port is the sum of |da[j]| it moves towards, the switching
+// rules look the candidates up instead of scanning the dimensions
+void nbh_table(struct ts_sim *s)
+{
+  int j, x, c, np, w, t, n=1, m=0, cap, d=s->d, da[d], db[d], *o;
+
+  for(j=0;j<d;j++)
+  {
+    if(s->radius>=s->kk[j]) error_exit("neighbourhood radius not below the size");
+    if((double)n*(2*s->kk[j]-1)>=INT_MAX) error_exit("neighbourhood: torus too large for the port tables");
+    n*=2*s->kk[j]-1;
+  }
+  cap=n+s->n_ports;
+  s->cand_start=malloc((n+1)*sizeof(int));
+  s->cand=malloc(cap*sizeof(int));
+  s->cand_w=malloc(cap*sizeof(int));
+  if( s->cand_start==NULL || s->cand==NULL || s->cand_w==NULL ) error_exit("no memory for port tables");
+  for(x=0;x<n;x++)
+  {
+    s->cand_start[x]=m;
+    for(j=d-1,t=x;j>=0;j--) { da[j]=t%(2*s->kk[j]-1)-(s->kk[j]-1); t/=2*s->kk[j]-1; }
+    for(j=0;j<d && (!s->wrap[j] || 2*ABS(da[j])<=s->kk[j]);j++);
+    if(j<d || (t=nbh_dist(s,da))==0) continue; // not a shortest difference
+    for(np=0;np<s->n_ports;np++)
+    {
+      o=s->poff+np*d;
+      for(j=w=0;j<d;j++)
+      {
+        db[j]=da[j]-o[j];
+        if(s->wrap[j]) db[j]=s->dtab_c[j][(db[j]%s->kk[j]+s->kk[j])%s->kk[j]];
+        if(o[j]!=0 && SIGN(o[j])==SIGN(da[j])) w+=ABS(da[j]);
+      }
+      if(nbh_dist(s,db)!=t-1) continue;
+      if(m+1>cap)
+      {
+        cap*=2;
+        s->cand=realloc(s->cand,cap*sizeof(int));
+        s->cand_w=realloc(s->cand_w,cap*sizeof(int));
+        if( s->cand==NULL || s->cand_w==NULL ) error_exit("no memory for port tables");
+      }
+      // insert by decreasing weight, ports in order on ties
+      if(w<1) w=1;
+      for(c=m;c>s->cand_start[x] && s->cand_w[c-1]<w;c--)
+      {
+        s->cand[c]=s->cand[c-1];
+        s->cand_w[c]=s->cand_w[c-1];
+      }
+      s->cand[c]=np;
+      s->cand_w[c]=w;
+      m++;
+    }
+  }
+  s->cand_start[n]=m;
+} /* nbh_table */
+
+// channels of the ports, mesh dimensions lose the offsets crossing the edge
+int nbh_channels(struct ts_sim *s)
+{
+  int np, j, c, n=0, *o;
+
+  for(np=0;np<s->n_ports;np++)
+  {
+    o=s->poff+np*s->d;
+    for(j=0,c=1;j<s->d;j++) c*=s->wrap[j]?s->kk[j]:s->kk[j]-ABS(o[j]);
+    n+=c;
+  }
+  return n;
+} /* nbh_channels */
+
+// per dimension sizes and wraparound, numbers of nodes and channels,
+// distance tables
+void topo_init(struct ts_sim *s)
+{
+  int j, d;
+  size_t lw=(s->wrap_spec!=NULL)?strlen(s->wrap_spec):0;
+
+  if(s->ready) return;
+  if(s->n_ksz>1) s->d=s->n_ksz;
+  d=s->d;
+  if(lw>1 && lw!=d) error_exit("wrap mask length differs from dimension");
+  free(s->kk); free(s->wrap); free(s->dtab); free(s->dtab_c);
+  free(s->poff); free(s->pdim); free(s->cand_start); free(s->cand); free(s->cand_w);
+  s->cand_start=s->cand=s->cand_w=NULL;
+  s->kk=malloc(d*sizeof(int));
+  s->wrap=malloc(d*sizeof(int));
+  if( s->kk==NULL || s->wrap==NULL ) error_exit("no memory for sizes");
+  s->n_nodes=1;
+  for(j=0;j<d;j++)
+  {
+    s->kk[j]=(s->n_ksz>1)?s->ksz[j]:s->k;
+    s->wrap[j]=(lw==0)?1:s->wrap_spec[(lw==1)?0:j]-'0';
+    s->n_nodes*=s->kk[j];
+  }
+  nbh_ports(s);
+  adr_diff_table(s);
+  s->n_chan=0;
+  if(s->nbh=='n' && s->radius==1)
+  {
+    if(s->n_ports!=N_OF_PORTS(d)) error_exit("von Neumann ports");
+    for(j=0;j<d;j++) s->n_chan+=2*(s->n_nodes/s->kk[j])*(s->wrap[j]?s->kk[j]:s->kk[j]-1);
+  }
+  else
+  {
+    nbh_table(s);
+    s->n_chan=nbh_channels(s);
+  }
+  chan_times(s);
+  if(s->n_class>0) // the nodes generate at the sum of the class rates
+    for(j=0,s->lambda=0;j<s->n_class;j++) s->lambda+=s->cls[j].lambda;
+} /* topo_init */
+
+// mesh boundary port
+int topo_boundary(struct ts_sim *s, int *i, int np)
+{
+  int j=PORT_DIMENSION(np), x, *o;
+
+  if(s->cand==NULL) return !s->wrap[j] && i[j]==((PORT_DIRECTION(np)<0)?0:s->kk[j]-1);
+  o=s->poff+np*s->d;
+  for(j=0;j<s->d;j++)
+  {
+    x=i[j]+o[j];
+    if(!s->wrap[j] && (x<0 || x>=s->kk[j])) return 1;
+  }
+  return 0;
+} /* topo_boundary */
+
+// exact distribution of distances between nodes pt[0..tm], tm the diameter:
+// convolution of the per dimension distributions p0[j*(tm+1)+x]
+int topo_distances(struct ts_sim *s, double *pt, double *p0)
+{
+  int j, x, t, tm=0, dm, k, d=s->d;
+  double *pd, *pn;
+
+  for(j=0;j<d;j++) tm+=s->wrap[j]?s->kk[j]/2:s->kk[j]-1;
+  if(pt==NULL) return tm;
+  pn=malloc((tm+1)*sizeof(double));
+  if( pn==NULL ) error_exit("no memory for distances");
+  for(t=0;t<=tm;t++) pt[t]=0;
+  pt[0]=1;
+  for(j=0,dm=0;j<d;j++)
+  {
+    k=s->kk[j];
+    pd=p0+j*(tm+1);
+    for(x=0;x<=tm;x++) pd[x]=0;
+    if(s->wrap[j]) for(x=0;x<k;x++) pd[(x<k-x)?x:k-x]+=1.0/k;
+    else for(x=0;x<k;x++) pd[x]=(x==0)?1.0/k:2.0*(k-x)/((double)k*k);
+    for(t=0;t<=tm;t++) pn[t]=0;
+    for(t=0;t<=dm;t++)
+      for(x=0;x<=tm-t;x++) pn[t+x]+=pt[t]*pd[x];
+    for(t=0;t<=tm;t++) pt[t]=pn[t];
+    dm+=s->wrap[j]?k/2:k-1;
+  }
+  free(pn);
+  return tm;
+} /* topo_distances */
+
+// mean distance between distinct nodes
+double topo_mean_distance(struct ts_sim *s)
+{
+  int t, tm=topo_distances(s,NULL,NULL);
+  double pt[tm+1], p0[s->d*(tm+1)], h=0;
+
+  topo_distances(s,pt,p0);
+  for(t=1;t<=tm;t++) h+=t*pt[t];
+  return h/(1-pt[0]);
+} /* topo_mean_distance */
+
+// links cut by halving the torus across a dimension, the least of dimensions
+long topo_bisection(struct ts_sim *s)
+{
+  int j;
+  long b, bmin=LONG_MAX;
+
+  for(j=0;j<s->d;j++)
+  {
+    b=(long)(s->n_nodes/s->kk[j])*((s->wrap[j] && s->kk[j]>2)?2:1);
+    if(b<bmin) bmin=b;
+  }
+  return bmin;
+} /* topo_bisection */
+
+// one --key=value parameter, returns 0 for an unknown key or value
+int ts_sim_configure(struct ts_sim *s, char *a)
+{
+  if(s->ready) return 0;
+  if(strncmp(a,"--d=",4)==0) {s->d=atoi(a+4);return s->d>0;}
+  else if(strncmp(a,"--k=",4)==0) return topo_sizes(s,a+4);
+  else if(strncmp(a,"--wrap=",7)==0) {free(s->wrap_spec);s->wrap_spec=strdup(a+7);return strspn(a+7,"01")==strlen(a+7) && a[7]!=0;}
+  else if(strncmp(a,"--nbh=",6)==0) {s->nbh=a[6];return strcmp(a+6,"neumann")==0 || strcmp(a+6,"moore")==0;}
+  else if(strncmp(a,"--radius=",9)==0) {s->radius=atoi(a+9);return s->radius>0;}
+  else if(strncmp(a,"--r=",4)==0) {s->rule=a[4];return s->rule>='a' && s->rule<='f' && a[5]==0;}
+  else if(strncmp(a,"--cht=",6)==0) {s->cht=atoi(a+6);return s->cht>0;}
+  else if(strncmp(a,"--bl=",5)==0) {s->bl=atoi(a+5);return 1;}
+  else if(strncmp(a,"--lambda=",9)==0) {s->lambda=atof(a+9);return 1;}
+  else if(strncmp(a,"--maxst=",8)==0) {s->max_st=atol(a+8);return 1;}
+  else if(strncmp(a,"--engine=",9)==0) {s->engine=a[9];return strcmp(a+9,"event")==0 || strcmp(a+9,"lockstep")==0;}
+  else if(strncmp(a,"--model=",8)==0) {s->model=a[8];return strcmp(a+8,"sim")==0 || strcmp(a+8,"analytic")==0 || strcmp(a+8,"hybrid")==0;}
+  else if(strncmp(a,"--calst=",8)==0) {s->cal_st=atol(a+8);return 1;}
+  else if(strncmp(a,"--seed=",7)==0) {s->seed=strtoul(a+7,NULL,10);return 1;}
+  else if(strncmp(a,"--stats-interval=",17)==0) {s->stats_interval=atol(a+17);return s->stats_interval>=0;}
+  else if(strncmp(a,"--stats-file=",13)==0) {free(s->stats_file);s->stats_file=strdup(a+13);return s->stats_file!=NULL;}
+  else if(strncmp(a,"--stats-format=",15)==0) {s->stats_format=a[15];return strcmp(a+15,"csv")==0 || strcmp(a+15,"bin")==0;}
+  else if(strncmp(a,"--lat=",6)==0) {free(s->lat_spec);s->lat_spec=strdup(a+6);return s->lat_spec!=NULL;}
+  else if(strncmp(a,"--bw=",5)==0) {free(s->bw_spec);s->bw_spec=strdup(a+5);return s->bw_spec!=NULL;}
+  else if(strncmp(a,"--size=",7)==0) return size_spec(s,a+7);
+  else if(strncmp(a,"--faults=",9)==0) {free(s->faults);s->faults=strdup(a+9);return s->faults!=NULL;}
+  else if(strncmp(a,"--detours=",10)==0) {s->max_mis=atoi(a+10);return s->max_mis>=0;}
+  else if(strcmp(a,"--perf")==0) {s->perf=1;return 1;}
+  else if(strncmp(a,"--coll=",7)==0) return coll_spec(s,a+7);
+  else if(strncmp(a,"--coll-reps=",12)==0) {s->coll_reps=atoi(a+12);return s->coll_reps>0;}
+  else if(strncmp(a,"--coll-overhead=",16)==0) {s->coll_overhead=atol(a+16);return s->coll_overhead>=0;}
+  else if(strncmp(a,"--class=",8)==0) return class_spec(s,a+8);
+  else if(strncmp(a,"--source=",9)==0) return src_spec(s,a+9);
+  else if(strncmp(a,"--arb=",6)==0) {s->arb=a[6];return strcmp(a+6,"fifo")==0 || strcmp(a+6,"strict")==0 || strcmp(a+6,"wrr")==0;}
+  else if(strncmp(a,"--dbg=",6)==0) {s->dbg=atoi(a+6);return 1;}
+  else return 0;
+} /* ts_sim_configure */
+
+void ts_sim_print_input(struct ts_sim *s, FILE *f)
+{
+  fprintf(f,"***** Input information *****\n");
+  int j;
+
+  topo_init(s);
+  fprintf(f,"torus dimensions d=%d, size k=%d",s->d,s->kk[0]);
+  for(j=1;j<s->d;j++) if(s->n_ksz>1) fprintf(f,",%d",s->kk[j]);
+  fprintf(f,"\n");
+  if(s->wrap_spec!=NULL)
+  {
+    fprintf(f,"wraparound ");
+    for(j=0;j<s->d;j++) fprintf(f,"%d",s->wrap[j]);
+    fprintf(f," (0: mesh)\n");
+  }
+  if(s->cand!=NULL)
+    fprintf(f,"%s neighbourhood, radius %d: %d ports, %d channels\n",(s->nbh=='m')?"Moore":"von Neumann",s->radius,s->n_ports,s->n_chan);
+  else if(s->n_ksz>1 || s->wrap_spec!=NULL)
+    fprintf(f,"mean distance %le, bisection width %ld links\n",topo_mean_distance(s),topo_bisection(s));
+  fprintf(f,"lambda=%le, cht=%d, bl=%d\n",s->lambda,s->cht,s->bl);
+  fprintf(f,"switching rule %c\n",s->rule);
+  if(s->lat_spec!=NULL || s->bw_spec!=NULL)
+  {
+    fprintf(f,"channel latency");
+    for(j=0;j<s->d;j++) fprintf(f,"%c%ld",(j==0)?' ':',',s->lat[j]);
+    fprintf(f," (mtu), bandwidth");
+    for(j=0;j<s->d;j++) fprintf(f,"%c%le",(j==0)?' ':',',1/s->tpb[j]);
+    fprintf(f," (bytes/mtu)\n");
+  }
+  if(s->size_kind=='u') fprintf(f,"packet size uniform %.0f-%.0f (bytes)\n",s->size_a,s->size_b);
+  else if(s->size_kind=='b') fprintf(f,"packet size %.0f or %.0f with probability %le (bytes)\n",s->size_a,s->size_b,s->size_p);
+  else if(s->size_kind=='e') fprintf(f,"packet size exponential, mean %.0f (bytes)\n",s->size_a);
+  else if(s->size_a!=1) fprintf(f,"packet size %.0f (bytes)\n",s->size_a);
+  if(s->faults!=NULL) fprintf(f,"faults %s, detours %d\n",s->faults,s->max_mis);
+  for(j=0;j<s->n_class;j++)
+  {
+    fprintf(f,"class %d: lambda=%le, %s destinations",j,s->cls[j].lambda,class_pattern[strchr(class_kind,s->cls[j].pattern)-class_kind]);
+    if(s->cls[j].size>0) fprintf(f,", size %d (bytes)",s->cls[j].size);
+    if(s->arb=='w') fprintf(f,", weight %d",s->cls[j].weight);
+    fprintf(f,"\n");
+  }
+  if(s->n_class>0) fprintf(f,"arbitration: %s\n",arb_name[strchr("fsw",s->arb)-"fsw"]);
+  if(s->src_kind=='o' || s->src_kind=='m')
+    fprintf(f,"%s sources: burst %le packets, duty %le, ratio %le\n",(s->src_kind=='o')?"on/off":"mmpp",
+      s->src_burst,s->src_duty,(s->src_kind=='o')?0:s->src_ratio);
+  else if(s->src_kind!='p')
+    fprintf(f,"closed loop sources%s: window %d, think time %le (mtu), no poisson traffic\n",
+      (s->src_kind=='r')?" (request/reply)":"",s->window,s->think);
+  if(s->coll)
+    fprintf(f,"collective %s, repetitions %d, send overhead %ld (mtu), no poisson traffic\n",
+      coll_name[strchr(coll_kind,s->coll)-coll_kind],s->coll_reps,s->coll_overhead);
+  fprintf(f,"engine %s\n\n",(s->engine=='l')?"lockstep":"event");
+  fprintf(f,"simulating...\n\n");
+} /* ts_sim_print_input */
+
+void ts_sim_print_statistics(struct ts_sim *s, FILE *f)
+{
+  struct ts_stat *t = &s->stat;
+
+  if(s->model=='h' && s->cal_done)
+  {
+    if(isfinite(s->cal))
+      fprintf(f,"hybrid model: calibration run %ld (mtu), waiting time factor %le\n\n",s->cal_st,s->cal);
+    else
+      fprintf(f,"hybrid model: calibration run %ld (mtu), measured waiting time %le (mtu per hop), analytic rho>=1\n\n",
+        s->cal_st,s->cal_wait);
+  }
+  fprintf(f,"***** Simulation Statistics *****\n");
+  fprintf(f,"simulation time: %ld (mtu)\n",s->st);
+  fprintf(f,"generated packets: %ld\n",t->generated_packets);
+  fprintf(f,"delevered packets: %ld\n",t->delevered_packets);
+  fprintf(f,"queued packets: %ld\n",t->queued_packets);
+  fprintf(f,"dropped packets: %ld (%le %%)\n",t->dropped_packets,(double)t->dropped_packets/t->delevered_packets*100.0);
+  fprintf(f,"torus performanse: %le (pkt/mtu)\n", ((double)t->delevered_packets)/s->st);
+  fprintf(f,"torus load: %le (%%)\n",t->chan_work_time/(s->st*s->n_chan)*100.0 );
+  fprintf(f,"average hops per packet: %le\n",t->sum_of_hops/t->delevered_packets);
+  fprintf(f,"average packet channel time: %e (mtu)\n",t->sum_of_packet_avg_chan_time/t->delevered_packets);
+  if(s->engine=='l' && s->model=='s')
+    fprintf(f,"injection quantisation: %le (mtu) average delay, < %d (mtu)\n",t->sum_of_inj_delay/t->generated_packets,s->cht);
+  if(!chan_uniform(s))
+    fprintf(f,"delivered bytes: %.0f, %le (bytes/mtu)\n",t->delivered_bytes,t->delivered_bytes/s->st);
+  if(s->faults!=NULL)
+  {
+    fprintf(f,"faults: %d dead links, %d dead nodes\n",s->n_dead_links,s->n_dead_nodes);
+    fprintf(f,"undeliverable packets: %ld (%le %%)\n",t->undeliverable_packets,(double)t->undeliverable_packets/t->generated_packets*100.0);
+    fprintf(f,"misrouted hops: %ld (%le per delivered packet)\n",t->misrouted_hops,(double)t->misrouted_hops/t->delevered_packets);
+    fprintf(f,"not delivered: %le %% of generated packets\n",(1-(double)t->delevered_packets/t->generated_packets)*100.0);
+  }
+  if(s->cstep!=NULL) coll_statistics(s,f);
+  if(s->src_kind!='p') src_statistics(s,f);
+  if(s->cstat!=NULL) class_statistics(s,f);
+  if(s->pc!=NULL)
+  {
+    fprintf(f,"\n");
+    ts_perf_print(s->pc,f,t->n_events);
+  }
+} /* ts_sim_print_statistics */
+
+// normalised configuration: every parameter that changes the results with
+// the resolved per dimension values, the fault file by its content hash and
+// the build of the library; 0 when it does not identify the results (seed
+// from time) or does not fit
+int ts_sim_describe(struct ts_sim *s, char *buf, int size)
+{
+  int j, n, c;
+  char a[64];
+  double rate;
+  unsigned long long h=TS_FNV_BASIS;
+  FILE *f;
+
+  if(s->seed==0) return 0;
+  topo_init(s);
+  n=snprintf(buf,size,"ts version %s; d=%d k=",TS_VERSION,s->d);
+#define DESC(...) do { if(n<size) n+=snprintf(buf+n,size-n,__VA_ARGS__); } while(0)
+  for(j=0;j<s->d;j++) DESC("%s%d",(j==0)?"":",",s->kk[j]);
+  DESC(" wrap=");
+  for(j=0;j<s->d;j++) DESC("%d",s->wrap[j]);
+  DESC(" nbh=%c radius=%d lat=",s->nbh,s->radius);
+  for(j=0;j<s->d;j++) DESC("%s%ld",(j==0)?"":",",s->lat[j]);
+  DESC(" tpb=");
+  for(j=0;j<s->d;j++) DESC("%s%.17g",(j==0)?"":",",s->tpb[j]);
+  DESC(" r=%c lambda=%.17g cht=%d bl=%d size=%c,%.17g,%.17g,%.17g maxst=%ld engine=%c model=%c calst=%ld seed=%u",
+    s->rule,s->lambda,s->cht,s->bl,s->size_kind,s->size_a,s->size_b,s->size_p,s->max_st,s->engine,s->model,s->cal_st,s->seed);
+  if(s->faults!=NULL)
+  {
+    if(sscanf(s->faults,"%lf%n",&rate,&c)==1 && s->faults[c]==0) DESC(" faults=%.17g",rate);
+    else
+    {
+      f=fopen(s->faults,"r");
+      if(f==NULL) return 0;
+      while( (c=fread(a,1,sizeof(a),f)) > 0 ) h=ts_fnv1a(a,c,h);
+      fclose(f);
+      DESC(" faults=file:%016llx",h);
+    }
+    DESC(" detours=%d",s->max_mis);
+  }
+  if(s->coll) DESC(" coll=%c reps=%d overhead=%ld",s->coll,s->coll_reps,s->coll_overhead);
+  for(j=0;j<s->n_class;j++) DESC(" class=%.17g,%d,%c,%d",s->cls[j].lambda,s->cls[j].size,s->cls[j].pattern,s->cls[j].weight);
+  if(s->n_class>0) DESC(" arb=%c",s->arb);
+  if(s->src_kind!='p')
+    DESC(" source=%c,%.17g,%.17g,%.17g,%d,%.17g",s->src_kind,s->src_burst,s->src_duty,s->src_ratio,s->window,s->think);
+#undef DESC
+  return (n<size)?n:0;
+} /* ts_sim_describe */
+
+void ts_sim_stats(struct ts_sim *s, struct ts_stat *t)
+{
+  *t = s->stat;
+  t->st = s->st;
+  t->n_chan = s->n_chan;
+} /* ts_sim_stats */
+
+__thread jmp_buf * ts_error_jmp;
+__thread char ts_error_msg[256];
+
+int error_exit(char message[])
+{
+  if(ts_error_jmp!=NULL)
+  {
+    // a service worker: the request fails, the process goes on
+    snprintf(ts_error_msg,sizeof(ts_error_msg),"%s",message);
+    longjmp(*ts_error_jmp,1);
+  }
+  fprintf(stderr,"*** error: %s\n",message);
+#ifdef TS_MPI
+  {
+    int up, down;
+    // the other ranks would wait in the next exchange
+    MPI_Initialized(&up);
+    MPI_Finalized(&down);
+    if(up && !down) MPI_Abort(MPI_COMM_WORLD,1);
+  }
+#endif
+  exit(1);
+}
+
+void init_index(int *i, int d)
+{
+  int j;
+  for( j=0; j<d; j++ ) i[j] = 0;
+} /* init_index */
+
+int next_index(int *i, int d, int *k)
+{
+   int j=d-1, go = 1, nxt=1;
+
+   while( go )
+   {
+     (i[j])++;
+     if( i[j] >= k[j] )
+     {
+       if( j == 0 ) { go=0; nxt=0; }
+       else
+       {
+	     i[j]=0;
+	     j--;
+       }
+     }
+     else go=0;
+   } /* while go */
+   return nxt;
+} /* next_index */
+
+int node_number(int * i, int d, int *k)
+{
+  int j, nn=i[0];
+  for(j=1;j<d;j++) { nn*=k[j]; nn+=i[j]; }
+  return nn;
+} /* node_number */
+
+void node_index(int nn, int * i, int d, int *k)
+{
+  int j;
+  for(j=d-1;j>=0;j--) { i[j]=nn%k[j]; nn/=k[j]; }
+} /* node_index */
+
+int port_number(int m, int r)
+{
+  int np=2*m+((r==-1)?0:1);
+  return np;
+} /* node_number */
+
+double ran_expo(double lambda, unsigned int *rng)
+{
+  double u;
+  u = rand_r(rng) / (RAND_MAX + 1.0);
+  return -log(1-u) / lambda;
+}
+
+simtime packet_interval(double lambda, unsigned int *rng)
+{
+  simtime dt = ran_expo(lambda,rng);
+  if(dt <=0 )dt=1;
+  return dt;
+} /* packet_interval */
+
+// natural logarithm of x>0 without calls or branches, so a loop over it
+// vectorises (libm log is a call per element): x = 2^e m with m in
+// [sqrt(1/2),sqrt(2)), log m = 2 atanh f, f = (m-1)/(m+1), |f| < 0.172,
+// by its series to f^23; within a few ulp of log
+static inline __attribute__((always_inline)) double vec_log(double x)
+{
+  union { double d; unsigned long long b; } v, e;
+  double m, f, z, p;
+
+  v.d = x;
+  e.b = 0x4330000000000000ULL | (v.b>>52); // 2^52 + biased exponent
+  v.b = (v.b & 0x000fffffffffffffULL) | 0x3ff0000000000000ULL; // m in [1,2)
+  m = v.d;
+  z = e.d - 4503599627370496.0 - 1023;
+  z = (m>1.4142135623730951) ? z+1 : z;
+  m = (m>1.4142135623730951) ? m*0.5 : m;
+  f = (m-1)/(m+1);
+  p = f*f;
+  p = 1+p*(1/3.+p*(1/5.+p*(1/7.+p*(1/9.+p*(1/11.+p*(1/13.+p*(1/15.+p*(1/17.+p*(1/19.+p*(1/21.+p*(1/23.)))))))))));
+  return z*6.93147180369123816490e-01 + (2*f*p + z*1.90821492927058770002e-10);
+} /* vec_log */
+
+// exponential gaps for a batch of uniforms; SoA loop without calls that the
+// compiler vectorises (4 lanes in the avx2 clone); the gap is truncated by
+// floor and the 2^52 bias, as avx2 has no double to 64 bit conversion
+SIMD_CLONES
+void expo_gaps(double *u, simtime *dt, int m, double lambda)
+{
+  union { double d; long long b; } v;
+  int a;
+  double g, il = 1/lambda;
+
+  for(a=0;a<m;a++)
+  {
+    g = floor(-vec_log(1-u[a]) * il);
+    g = (g<1) ? 1 : (g>1e15) ? 1e15 : g;
+    v.d = g + 4503599627370496.0;
+    dt[a] = v.b - 0x4330000000000000LL;
+  }
+} /* expo_gaps */
+
+void i_copy(int * from, int * to, int d)
+{
+  memcpy((void *)to, (void *)from, d*sizeof(int));
+} /* i_copy */
+
+void gen_dest( int * source, int * dest, int d, int *k, unsigned int *rng )
+{
+  int j;
+  do {
+    for(j=0;j<d;j++)dest[j] = rand_r(rng) % k[j];
+  }while(memcmp((void *)source, (void *)dest, d*sizeof(int))==0);
+} /* gen_dest */
+
+// uniform destination node number except the source, no rejection loop
+int gen_dest_number( int src, int n_nodes, unsigned int *rng )
+{
+  int dn = rand_r(rng) % (n_nodes-1);
+  return (dn>=src) ? dn+1 : dn;
+} /* gen_dest_number */
+
+void next_hop(int * i,int * ii, int np, int d, int *k)
+{
+  int pd, pr;
+  i_copy(i,ii,d);
+  pd=PORT_DIMENSION(np);
+  pr=PORT_DIRECTION(np);
+  ii[pd]=TORUS_NEIGHBOR(i[pd],pr,k[pd]);
+} /* move_packet_to_netx_hop */
+
+// neighbour of i through port np of the configured neighbourhood
+void node_hop(struct ts_sim *s, int *i, int *ii, int np)
+{
+  int j, *o;
+
+  if(s->cand==NULL) { next_hop(i,ii,np,s->d,s->kk); return; }
+  o=s->poff+np*s->d;
+  for(j=0;j<s->d;j++)
+  {
+    ii[j]=i[j]+o[j];
+    if(ii[j]<0) ii[j]+=s->kk[j];
+    else if(ii[j]>=s->kk[j]) ii[j]-=s->kk[j];
+  }
+} /* node_hop */
+
+/////////////////////////// rules of packet switching
+
+int sw_pkt_rule_a(struct ts_sim *s, struct packet *p, int nn, unsigned int *rng) // rule a
+{
+  int j, np;
+
+  for(j=0;j<s->d;j++)
+  {
+    if( p->da[j]!=0 )
+    {
+      np=port_number(j,SIGN(p->da[j]));
+
+if(s->dbg>1)
+{
+printf("packet switched to j=%d, np=%d\n",j,np);
+}
+
+      if( s->n[nn].port_pkt[np]==NULL)
+        return np;
+      else return -1;
+    }
+  }
+  return -1;
+} /* sw_pkt_rule_a */
+
+int sw_pkt_rule_b(struct ts_sim *s, struct packet *p, int nn, unsigned int *rng) // rule b
+{
+  int j, np, altp=0,pseqn;
+
+  // alternative ports
+  for(j=0;j<s->d;j++)
+  {
+    if( p->da[j]!=0 )
+    {
+      altp++;
+    }
+  }
+  if(altp==0) error_exit("rule b: switching at destination");
+
+  // random choice of alternative port
+  pseqn=rand_r(rng)%altp;
+  for(j=0;j<s->d;j++)
+  {
+    if(p->da[j]!=0)
+    {
+      if(pseqn<=0)
+      {
+         np=port_number(j,SIGN(p->da[j]));
+         if( s->n[nn].port_pkt[np]==NULL)
+           return np;
+         else return -1;
+      }
+      pseqn--;
+    }
+  }
+  error_exit("rule b: not switched");
+  return -1;
+} /* sw_pkt_rule_b */
+
+int sw_pkt_rule_c(struct ts_sim *s, struct packet *p, int nn, unsigned int *rng) // rule c
+{
+  int j, np, altp=0,rz,z=0;
+
+  // alternative ports
+  for(j=0;j<s->d;j++)
+  {
+    if( p->da[j]!=0 )
+    {
+      altp++;
+      z+=ABS(p->da[j]);
+    }
+  }
+  if(altp==0) error_exit("rule c: switching at destination");
+
+if(s->dbg>1)
+{
+printf("rule c: altp=%d, z=%d\n",altp,z);
+}
+
+  // random choice of alternative port
+  rz=rand_r(rng)%z;
+  for(j=0;j<s->d;j++)
+  {
+    if(p->da[j]!=0)
+    {
+
+if(s->dbg>2)
+{
+printf("rule c: best available port: da[j]=%d, j=%d, rz=%d\n",p->da[j],j,rz);
+}
+
+      if(rz<=ABS(p->da[j]))
+      {
+         np=port_number(j,SIGN(p->da[j]));
+         if( s->n[nn].port_pkt[np]==NULL)
+           return np;
+         else return -1;
+      }
+      rz-=ABS(p->da[j]);
+    }
+  }
+  error_exit("rule c: not switched");
+  return -1;
+} /* sw_pkt_rule_c */
+
+int sw_pkt_rule_d(struct ts_sim *s, struct packet *p, int nn, unsigned int *rng) // rule d
+{
+  int j, np;
+
+  for(j=0;j<s->d;j++)
+  {
+    if( p->da[j]!=0 )
+    {
+      np=port_number(j,SIGN(p->da[j]));
+
+if(s->dbg>1)
+{
+printf("packet switched to j=%d, np=%d\n",j,np);
+}
+
+      if( s->n[nn].port_pkt[np]==NULL)
+        return np;
+    }
+  }
+  return -1;
+} /* sw_pkt_rule_d */
+
+int sw_pkt_rule_e(struct ts_sim *s, struct packet *p, int nn, unsigned int *rng) // rule e
+{
+  int j, np, altp=0,pseqn;
+  int dap[s->d];
+
+  i_copy(p->da,dap,s->d);
+
+  // availability of alternative ports
+  for(j=0;j<s->d;j++)
+  {
+    if( p->da[j]!=0 )
+    {
+      np=port_number(j,SIGN(p->da[j]));
+      if( s->n[nn].port_pkt[np]==NULL)
+      {
+        altp++;
+
+      }
+      else
+        dap[j]=0;
+    }
+  }
+  if(altp==0) return -1;
+
+  // random choice of alternative port
+  pseqn=rand_r(rng)%altp;
+  for(j=0;j<s->d;j++)
+  {
+    if(dap[j]!=0)
+    {
+      if(pseqn==0) break;
+      pseqn--;
+    }
+  }
+  np=port_number(j,SIGN(dap[j]));
+  return np;
+} /* sw_pkt_rule_e */
+
+int sw_pkt_rule_f(struct ts_sim *s, struct packet *p, int nn, unsigned int *rng) // rule e
+{
+  int j, np, altp=0, rz, z=0;
+  int dap[s->d];
+
+  i_copy(p->da,dap,s->d);
+
+  // availability of alternative ports
+  for(j=0;j<s->d;j++)
+  {
+    if( p->da[j]!=0 )
+    {
+      np=port_number(j,SIGN(p->da[j]));
+      if( s->n[nn].port_pkt[np]==NULL)
+      {
+        altp++;
+        z+=ABS(p->da[j]);
+      }
+      else
+        dap[j]=0;
+    }
+  }
+  if(altp==0) return -1;
+
+  // random choice of alternative port
+  rz=rand_r(rng)%z;
+  for(j=0;j<s->d;j++)
+  {
+    if(dap[j]!=0)
+    {
+      if(rz<=ABS(dap[j]))
+      {
+         np=port_number(j,SIGN(dap[j]));
+         if( s->n[nn].port_pkt[np]==NULL)
+           return np;
+         else return -1;
+      }
+      rz-=ABS(dap[j]);
+    }
+  }
+  np=port_number(j,SIGN(dap[j]));
+  return np;
+} /* sw_pkt_rule_f */
+
+// rules a-f over the candidate ports of a generalised neighbourhood: a, d
+// the first (most progress), b, e a random one, c, f one with probability
+// proportional to its weight; d-f among the free candidates only; ports
+// crossing a mesh edge are not candidates
+int sw_pkt_rule_nbh(struct ts_sim *s, struct packet *p, int nn, int *i, unsigned int *rng)
+{
+  int c, np, m=0, z=0, rz, free_only=(s->rule>='d'), first=(s->rule=='a' || s->rule=='d');
+  int *cp=s->cand+s->cand_start[p->dix], *cw=s->cand_w+s->cand_start[p->dix];
+  int nc=s->cand_start[p->dix+1]-s->cand_start[p->dix], use[nc];
+
+  for(c=0;c<nc && !(first && m>0);c++)
+  {
+    np=cp[c];
+    if(s->wrap_spec!=NULL && topo_boundary(s,i,np)) continue;
+    if(free_only && s->n[nn].port_pkt[np]!=NULL) continue;
+    use[m++]=c;
+    z+=cw[c];
+  }
+  if(m==0) return -1;
+  if(s->rule=='b' || s->rule=='e') c=use[rand_r(rng)%m];
+  else if(s->rule=='c' || s->rule=='f')
+  {
+    rz=rand_r(rng)%z;
+    for(c=0;rz>=cw[use[c]];c++) rz-=cw[use[c]];
+    c=use[c];
+  }
+  else c=use[0];
+  np=cp[c];
+
+if(s->dbg>1)
+{
+printf("packet switched to np=%d of %d candidates\n",np,m);
+}
+
+  if( s->n[nn].port_pkt[np]==NULL)
+    return np;
+  else return -1;
+} /* sw_pkt_rule_nbh */
+
+//////////////////////////////// END rules of packet switching
+
+int sw_pkt_rule(struct ts_sim *s, struct packet *p, int nn, unsigned int *rng)
+{
+  int np=-1;
+
+  switch(s->rule)
+  {
+  case 'a': np=sw_pkt_rule_a(s,p,nn,rng); break;
+  case 'b': np=sw_pkt_rule_b(s,p,nn,rng); break;
+  case 'c': np=sw_pkt_rule_c(s,p,nn,rng); break;
+  case 'd': np=sw_pkt_rule_d(s,p,nn,rng); break;
+  case 'e': np=sw_pkt_rule_e(s,p,nn,rng); break;
+  case 'f': np=sw_pkt_rule_f(s,p,nn,rng); break;
+  default: error_exit("unknown switching rule");
+  }
+  return np;
+} /* sw_pkt_rule */
+
+// switching with faults: the rule chooses among live productive ports
+// (minimal routing), when all of them are dead the packet takes a free one
+// of the node's detour ports of its first productive port (non-minimal, at
+// most max_mis times, away from the destination only as the last resort),
+// chosen as rules d-f choose, or waits for the first of them to free; it
+// does not return through the detour at the next node
+int sw_pkt_fault(struct ts_sim *s, struct packet *p, int nn, unsigned int *rng)
+{
+  int j, c, np, q, m=0, d=s->d, P=s->n_ports, live=0, da[d], ports[P];
+  unsigned int al=s->alive[nn], away=0, dm=0, rest=0;
+  unsigned char *dt;
+
+  if(s->dead[node_number(p->dest,d,s->kk)]) return SW_LOST;
+  p->dports=0;
+
+  i_copy(p->da,da,d);
+  for(j=0;j<d;j++)
+  {
+    if(p->da[j]!=0)
+    {
+      np=port_number(j,SIGN(p->da[j]));
+      away|=1u<<(np^1);
+      if(((al>>np)&1) && np!=p->back) live++;
+      else p->da[j]=0;
+    }
+  }
+  if(live>0)
+  {
+    p->back=-1;
+    np=sw_pkt_rule(s,p,nn,rng);
+    i_copy(da,p->da,d);
+    return np;
+  }
+  i_copy(da,p->da,d);
+
+  // detour around the first productive port
+  if(p->mis>=s->max_mis) return SW_LOST;
+  for(j=0;p->da[j]==0;j++);
+  dt=s->detour+(nn*P+port_number(j,SIGN(p->da[j])))*P;
+  for(c=0;c<P && (q=dt[c])!=DETOUR_END;c++)
+  {
+    if(q==p->back) continue;
+    if((away>>q)&1) { rest|=1u<<q; continue; }
+    dm|=1u<<q;
+    if(s->n[nn].port_pkt[q]==NULL) ports[m++]=q;
+  }
+  if(dm==0)
+  {
+    dm=rest;
+    for(c=0;c<P && (q=dt[c])!=DETOUR_END;c++)
+      if(((rest>>q)&1) && s->n[nn].port_pkt[q]==NULL) ports[m++]=q;
+  }
+  if(dm==0) return SW_LOST;
+  if(m==0)
+  {
+    p->dports=dm;
+    return -1;
+  }
+  np=(s->rule=='a' || s->rule=='d')?ports[0]:ports[rand_r(rng)%m];
+  p->mis++;
+  s->stat.misrouted_hops++;
+
+if(s->dbg>1)
+{
+printf("detour to port %d of %d free at node %d\n",np,m,nn);
+}
+
+  p->back=np^1;
+  return np;
+} /* sw_pkt_fault */
+
+int sw_pkt(struct ts_sim *s, struct packet *p, int * i, unsigned int *rng)
+{
+  int j, nn, d=s->d;
+
+  adr_diff(s,p->dest,i,p->da);
+  nn = node_number(i,d,s->kk);
+
+if(s->dbg>1)
+{
+printf("address difference (");
+for(j=0;j<d-1;j++) printf("%d,",p->da[j]);
+printf("%d) node %d\n",p->da[d-1],nn);
+}
+
+  if(s->cand!=NULL)
+  {
+    p->dix=nbh_index(s,p->da);
+    return sw_pkt_rule_nbh(s,p,nn,i,rng);
+  }
+  if(s->alive!=NULL) return sw_pkt_fault(s,p,nn,rng);
+  return sw_pkt_rule(s,p,nn,rng);
+} /* sw_pkt */
+
+///////////////////////////////////// pools of packets and events
+
+struct l2 * pool_alloc(struct pool *pl, size_t size)
+{
+  struct l2 *e;
+  char *b;
+  int c;
+
+  if( pl->free == NULL )
+  {
+    size = (size+7) & ~(size_t)7;
+    pl->size = size;
+    b = malloc(POOL_SLAB*size);
+    if( b==NULL ) error_exit("no memory for list elements");
+    if( pl->n_slab == pl->cap_slab )
+    {
+      pl->cap_slab = (pl->cap_slab==0) ? 16 : 2*pl->cap_slab;
+      pl->slab = realloc(pl->slab, pl->cap_slab*sizeof(void *));
+      if( pl->slab==NULL ) error_exit("no memory for list elements");
+    }
+    pl->slab[pl->n_slab++] = b;
+    for(c=POOL_SLAB-1;c>=0;c--)
+    {
+      e = (struct l2 *)(b+c*size);
+      e->content = (void *)(e+1);
+      e->next = pl->free;
+      pl->free = e;
+    }
+  }
+  e = pl->free;
+  pl->free = e->next;
+  return e;
+} /* pool_alloc */
+
+void pool_free(struct pool *pl, struct l2 *e)
+{
+  e->next = pl->free;
+  pl->free = e;
+} /* pool_free */
+
+void pool_destroy(struct pool *pl)
+{
+  int c;
+  for(c=0;c<pl->n_slab;c++) free(pl->slab[c]);
+  free(pl->slab);
+  memset(pl,0,sizeof(struct pool));
+} /* pool_destroy */
+
+// takes over the slabs of old when its elements have the size, all free
+void pool_reuse(struct pool *pl, struct pool *old, size_t size)
+{
+  struct l2 *e;
+  int j, c;
+
+  size = (size+7) & ~(size_t)7;
+  if(old->n_slab==0 || old->size!=size || pl->n_slab>0)
+  {
+    pool_destroy(old);
+    return;
+  }
+  *pl = *old;
+  memset(old,0,sizeof(struct pool));
+  pl->free = NULL;
+  for(j=pl->n_slab-1;j>=0;j--)
+    for(c=POOL_SLAB-1;c>=0;c--)
+    {
+      e = (struct l2 *)((char *)pl->slab[j]+c*size);
+      e->content = (void *)(e+1);
+      e->next = pl->free;
+      pl->free = e;
+    }
+} /* pool_reuse */
+
+// list element, packet and its three addresses in one block
+struct l2 * pkt_alloc(struct ts_sim *s)
+{
+  struct l2 *pl2 = pool_alloc(&s->pkt_pool, sizeof(struct l2)+sizeof(struct packet)+3*s->d*sizeof(int));
+  struct packet *p = (struct packet *)pl2->content;
+
+  p->source = (int *)(p+1);
+  p->dest = p->source+s->d;
+  p->da = p->dest+s->d;
+  return pl2;
+} /* pkt_alloc */
+
+void pkt_free(struct ts_sim *s, struct l2 *pl2)
+{
+  pool_free(&s->pkt_pool,pl2);
+} /* pkt_free */
+
+// list element, event and its node address in one block
+void add_event(struct ts_sim *s, simtime at, int *i, int np, struct l2 *pkt)
+{
+  struct l2 *el2 = pool_alloc(&s->ev_pool, sizeof(struct l2)+sizeof(struct event)+s->d*sizeof(int));
+  struct event *e = (struct event *)el2->content;
+
+  e->at = at;
+  e->np = np;
+  e->pkt = pkt;
+  e->i = (int *)(e+1);
+  i_copy(i,e->i,s->d);
+  in_l2_order(&s->eq,el2,event_compare_content);
+} /* add_event */
+
+///////////////////////////////////// sources
+
+// on/off and mmpp: every node alternates between a high and a low state of
+// exponential durations; poisson arrivals at the rate of the state, the
+// mean rate is lambda and a high state brings burst packets on average
+
+simtime src_sojourn(struct ts_sim *s, int high)
+{
+  double t = s->src_burst/s->rate_hi;
+  if(!high) t *= (1-s->src_duty)/s->src_duty;
+  return packet_interval(1/t,&s->rng_gen);
+} /* src_sojourn */
+
+// next arrival of node nn after t
+simtime src_next(struct ts_sim *s, int nn, simtime t)
+{
+  double r;
+  simtime dt;
+
+  for(;;)
+  {
+    r = s->mstate[nn] ? s->rate_hi : s->rate_lo;
+    if(r>0)
+    {
+      dt = packet_interval(r,&s->rng_gen);
+      if(t+dt < s->mend[nn]) return t+dt;
+    }
+    t = s->mend[nn];
+    s->mstate[nn] ^= 1;
+    s->mend[nn] = t+src_sojourn(s,s->mstate[nn]);
+  }
+} /* src_next */
+
+// closed loop: a request of node src entering the network at time at
+void src_send(struct ts_sim *s, int src, simtime at)
+{
+  struct l2 *pl2 = pkt_alloc(s);
+  struct packet *p = (struct packet *)pl2->content;
+
+  p->send_time=at;
+  p->hops=0;
+  p->mis=0;
+  p->back=-1;
+  p->dports=0;
+  p->size=pkt_size(s);
+  p->tag=0;
+  p->cls=0;
+  p->qseq=0;
+  node_index(src,p->source,s->d,s->kk);
+  node_index(gen_dest_number(src,s->n_nodes,&s->rng_gen),p->dest,s->d,s->kk);
+  s->stat.generated_packets++;
+  s->outstanding[src]++;
+  add_event(s,at,p->source,-1,pl2);
+} /* src_send */
+
+// closed loop: the window slot of the transaction of p is free, a new
+// request follows after the think time
+void src_refill(struct ts_sim *s, struct packet *p)
+{
+  int src = node_number((p->tag==0)?p->source:p->dest,s->d,s->kk);
+
+  s->outstanding[src]--;
+  src_send(s,src,s->st+((s->think>0)?packet_interval(1/s->think,&s->rng_gen):0));
+} /* src_refill */
+
+// closed loop delivery at node nn: a request is answered by a reply (tag 1)
+// when the sources are request/reply, otherwise the round trip is complete
+void src_recv(struct ts_sim *s, int nn, struct packet *p)
+{
+  struct l2 *rl2;
+  struct packet *r;
+
+  if(s->src_kind=='r' && p->tag==0)
+  {
+    rl2 = pkt_alloc(s);
+    r = (struct packet *)rl2->content;
+    r->send_time=s->st;
+    r->req_time=p->send_time;
+    r->hops=0;
+    r->mis=0;
+    r->back=-1;
+    r->dports=0;
+    r->size=pkt_size(s);
+    r->tag=1;
+    r->cls=0;
+    r->qseq=0;
+    i_copy(p->dest,r->source,s->d);
+    i_copy(p->source,r->dest,s->d);
+    s->stat.generated_packets++;
+    add_event(s,s->st,r->source,-1,rl2);
+    return;
+  }
+  s->stat.completed_requests++;
+  s->stat.sum_of_rtt+=s->st-((p->tag==1)?p->req_time:p->send_time);
+  src_refill(s,p);
+} /* src_recv */
+
+void src_init(struct ts_sim *s)
+{
+  int nn;
+
+  if(s->src_kind=='c' || s->src_kind=='r')
+  {
+    if(s->engine!='e' || s->model!='s' || s->nranks>1) error_exit("closed loop sources are simulated by the event engine in one process");
+    if(s->coll || s->n_class>0) error_exit("closed loop sources replace the poisson traffic");
+    s->outstanding = calloc(s->n_nodes,sizeof(int));
+    if( s->outstanding==NULL ) error_exit("no memory for sources");
+    s->inj.t1 = s->max_st+1; // no poisson injections
+    for(nn=0;nn<s->n_nodes;nn++)
+      while(s->outstanding[nn]<s->window)
+        src_send(s,nn,(s->think>0)?packet_interval(1/s->think,&s->rng_gen):0);
+    return;
+  }
+  s->rate_hi = s->lambda/s->src_duty;
+  s->rate_lo = 0;
+  if(s->src_kind=='m')
+  {
+    s->rate_lo = s->lambda/(s->src_ratio*s->src_duty+1-s->src_duty);
+    s->rate_hi = s->src_ratio*s->rate_lo;
+  }
+  if(s->rate_hi<=0) error_exit("on/off and mmpp sources need lambda > 0");
+  s->mstate = malloc(s->n_nodes);
+  s->mend = malloc(s->n_nodes*sizeof(simtime));
+  if( s->mstate==NULL || s->mend==NULL ) error_exit("no memory for sources");
+  for(nn=s->node_lo;nn<s->node_hi;nn++)
+  {
+    s->mstate[nn] = rand_r(&s->rng_gen)/(RAND_MAX+1.0) < s->src_duty;
+    s->mend[nn] = src_sojourn(s,s->mstate[nn]);
+    s->next_gen[nn] = src_next(s,nn,0);
+  }
+} /* src_init */
+
+///////////////////////////////////// batched packet generation
+
+int inj_compare(const void *x1, const void *x2)
+{
+  const struct inj_rec *r1=(const struct inj_rec *)x1, *r2=(const struct inj_rec *)x2;
+  if(r1->at < r2->at) return -1;
+  else if(r1->at > r2->at) return 1;
+  else return r1->seq - r2->seq;
+} /* inj_compare */
+
+void inj_reserve(struct inj_buf *inj, int cap)
+{
+  if(cap <= inj->cap) return;
+  if(cap < 2*inj->cap) cap = 2*inj->cap;
+  inj->at = realloc(inj->at, cap*sizeof(simtime));
+  inj->src = realloc(inj->src, cap*sizeof(int));
+  inj->dst = realloc(inj->dst, cap*sizeof(int));
+  if( inj->at==NULL || inj->src==NULL || inj->dst==NULL ) error_exit("no memory for injections");
+  inj->cap = cap;
+} /* inj_reserve */
+
+// generate injections of all nodes within the next window [inj.t1,inj.t1+gen_window):
+// each sweep takes one pending generation of every node still inside the window
+// and draws the nodes' next gaps together, then the window is sorted by time
+void gen_batch(struct ts_sim *s)
+{
+  struct inj_buf *inj = &s->inj;
+  int *act = s->gen_act;
+  int na, a, m, nn, c;
+  simtime t1 = inj->t1 + s->gen_window;
+
+  inj->cnt = 0;
+  inj->pos = 0;
+  if(s->trace!=NULL)
+  {
+    // the window of a shared stream, already in time order
+    for(c=s->trace_pos; c<s->trace->cnt && s->trace->at[c]<t1; c++);
+    inj_reserve(inj,c-s->trace_pos);
+    inj->cnt = c-s->trace_pos;
+    memcpy(inj->at,s->trace->at+s->trace_pos,inj->cnt*sizeof(simtime));
+    memcpy(inj->src,s->trace->src+s->trace_pos,inj->cnt*sizeof(int));
+    memcpy(inj->dst,s->trace->dst+s->trace_pos,inj->cnt*sizeof(int));
+    s->trace_pos = c;
+    inj->t1 = t1;
+    return;
+  }
+  na = 0;
+  for(nn=s->node_lo;nn<s->node_hi;nn++) if(s->next_gen[nn] < t1) act[na++] = nn;
+
+  while( na > 0 )
+  {
+    inj_reserve(inj,inj->cnt+na);
+    for(a=0;a<na;a++)
+    {
+      inj->at[inj->cnt+a] = s->next_gen[act[a]];
+      inj->src[inj->cnt+a] = act[a];
+      if(s->mstate==NULL) s->gen_u[a] = rand_r(&s->rng_gen) / (RAND_MAX + 1.0);
+    }
+    if(s->mstate==NULL) expo_gaps(s->gen_u,s->gen_dt,na,s->lambda);
+    for(a=0,m=0;a<na;a++)
+    {
+      nn = act[a];
+      inj->dst[inj->cnt+a] = gen_dest_number(nn,s->n_nodes,&s->rng_gen);
+      if(s->mstate!=NULL) s->next_gen[nn] = src_next(s,nn,s->next_gen[nn]);
+      else s->next_gen[nn] += s->gen_dt[a];
+      if(s->next_gen[nn] < t1) act[m++] = nn;
+    }
+    inj->cnt += na;
+    na = m;
+  }
+  inj->t1 = t1;
+  if( inj->cnt == 0 ) return;
+
+  // sort the window by time keeping the generation order of equal times
+  if( inj->cnt > s->gen_sort_cap )
+  {
+    s->gen_sort_cap = inj->cap;
+    s->gen_sort = realloc(s->gen_sort, s->gen_sort_cap*sizeof(struct inj_rec));
+    if( s->gen_sort==NULL ) error_exit("no memory for generation");
+  }
+  for(c=0;c<inj->cnt;c++)
+  {
+    s->gen_sort[c].at = inj->at[c];
+    s->gen_sort[c].seq = c;
+    s->gen_sort[c].src = inj->src[c];
+    s->gen_sort[c].dst = inj->dst[c];
+  }
+  qsort(s->gen_sort,inj->cnt,sizeof(struct inj_rec),inj_compare);
+  for(c=0;c<inj->cnt;c++)
+  {
+    inj->at[c] = s->gen_sort[c].at;
+    inj->src[c] = s->gen_sort[c].src;
+    inj->dst[c] = s->gen_sort[c].dst;
+  }
+} /* gen_batch */
+
+// time of the next pending injection, refills the buffer when exhausted
+simtime next_injection(struct ts_sim *s)
+{
+  while( s->inj.pos >= s->inj.cnt )
+  {
+    if( s->inj.t1 > s->max_st ) return LONG_MAX;
+    gen_batch(s);
+  }
+  return s->inj.at[s->inj.pos];
+} /* next_injection */
+
+// the whole injection stream of the configuration (times, sources and
+// destinations), replayed by simulations of other rules through s->trace
+struct inj_buf * ts_sim_trace(struct ts_sim *s)
+{
+  struct inj_buf *tr = calloc(1,sizeof(struct inj_buf));
+
+  if( tr==NULL ) error_exit("no memory for injection stream");
+  ts_sim_init(s);
+  if(s->nranks>1 || s->coll || s->outstanding!=NULL)
+    error_exit("a shared injection stream needs poisson, on/off or mmpp sources in one process");
+  while( s->inj.t1 <= s->max_st )
+  {
+    gen_batch(s);
+    inj_reserve(tr,tr->cnt+s->inj.cnt);
+    memcpy(tr->at+tr->cnt,s->inj.at,s->inj.cnt*sizeof(simtime));
+    memcpy(tr->src+tr->cnt,s->inj.src,s->inj.cnt*sizeof(int));
+    memcpy(tr->dst+tr->cnt,s->inj.dst,s->inj.cnt*sizeof(int));
+    tr->cnt += s->inj.cnt;
+  }
+  while( tr->cnt>0 && tr->at[tr->cnt-1] > s->max_st ) tr->cnt--; // never injected
+  tr->t1 = s->inj.t1;
+  return tr;
+} /* ts_sim_trace */
+
+void ts_sim_trace_free(struct inj_buf *tr)
+{
+  if(tr==NULL) return;
+  free(tr->at);
+  free(tr->src);
+  free(tr->dst);
+  free(tr);
+} /* ts_sim_trace_free */
+
+///////////////////////////////////// collectives
+
+// each node runs the steps of the algorithm: a step sends its messages (a
+// packet each) and waits for the messages of the step from its peers; steps
+// are numbered through the repetitions and a message carries its step, the
+// messages of later steps arriving early are counted in a sparse per node
+// list, so the state is per node and per message in flight
+
+struct coll_early {
+  int tag;
+  int cnt;
+};
+
+int coll_find_content(void *x1, void *x2)
+{
+  return *(int *)x1 == ((struct coll_early *)x2)->tag;
+} /* coll_find_content */
+
+int coll_steps(struct ts_sim *s)
+{
+  int j, c=0, n=s->n_nodes;
+
+  switch(s->coll)
+  {
+  case 'r': return 2*(n-1);
+  case 'd': while((1<<c)<n) c++; return c;
+  case 't': for(j=0;j<s->d;j++) c+=2*(s->kk[j]-1); return c;
+  case 'a': return n-1;
+  case 'b': while((1<<c)<n) c++; return c;
+  default: return 1; // 'h'
+  }
+} /* coll_steps */
+
+// next node of the ring of dimension j from coordinate x: x+1 with
+// wraparound, on a mesh dimension the even coordinates upwards and the odd
+// ones back, so that no message crosses more than 2 channels
+int coll_ring_next(struct ts_sim *s, int j, int x)
+{
+  int k=s->kk[j];
+
+  if(s->wrap[j]) return TORUS_NEIGHBOR(x,1,k);
+  if(x%2==0) return (x+2<k)?x+2:(x+1<k)?x+1:x-1;
+  return (x>=3)?x-2:0;
+} /* coll_ring_next */
+
+// destinations of the messages of step c of node nn, *nr messages to receive:
+// ring allreduce: reduce-scatter and allgather to the next node; recursive
+// doubling: exchange with the node differing in bit c; torus allreduce: a
+// ring in each dimension; alltoall: pairwise, c+1 nodes ahead; broadcast:
+// binomial tree from node 0; halo: all neighbors
+int coll_step(struct ts_sim *s, int nn, int c, int *to, int *nr)
+{
+  int j, m, np, b, d=s->d, n=s->n_nodes, i[d], ii[d];
+
+  *nr=1;
+  switch(s->coll)
+  {
+  case 'r': to[0]=(nn+1)%n; return 1;
+  case 'd': to[0]=nn^(1<<c); return 1;
+  case 't':
+    for(j=0;c>=2*(s->kk[j]-1);j++) c-=2*(s->kk[j]-1);
+    node_index(nn,i,d,s->kk);
+    i_copy(i,ii,d);
+    ii[j]=coll_ring_next(s,j,i[j]);
+    to[0]=node_number(ii,d,s->kk);
+    return 1;
+  case 'a': to[0]=(nn+c+1)%n; return 1;
+  case 'b':
+    b=1<<c;
+    *nr=(nn>=b && nn<2*b);
+    if(nn<b && nn+b<n) {to[0]=nn+b; return 1;}
+    return 0;
+  default: // 'h'
+    node_index(nn,i,d,s->kk);
+    for(np=m=0;np<s->n_ports;np++)
+    {
+      if(topo_boundary(s,i,np)) continue;
+      node_hop(s,i,ii,np);
+      if((to[m]=node_number(ii,d,s->kk))!=nn) m++;
+    }
+    *nr=m;
+    return m;
+  }
+} /* coll_step */
+
+// a message enters its source node after the send overhead
+void coll_send(struct ts_sim *s, int src, int dst, int tag)
+{
+  struct l2 *pl2 = pkt_alloc(s);
+  struct packet *p = (struct packet *)pl2->content;
+
+  p->send_time=s->st;
+  p->hops=0;
+  p->mis=0;
+  p->back=-1;
+  p->dports=0;
+  p->size=pkt_size(s);
+  p->tag=tag;
+  node_index(src,p->source,s->d,s->kk);
+  node_index(dst,p->dest,s->d,s->kk);
+  s->stat.generated_packets++;
+  add_event(s,s->st+s->coll_overhead,p->source,-1,pl2);
+} /* coll_send */
+
+// steps of node nn whose messages have all been received
+void coll_advance(struct ts_sim *s, int nn)
+{
+  struct l2 *el;
+  int j, m, nr, c, tag, r, to[s->n_ports], total=s->coll_reps*s->coll_steps;
+
+  while(s->cstep[nn] < total)
+  {
+    tag = s->cstep[nn];
+    c = tag % s->coll_steps;
+    m = coll_step(s,nn,c,to,&nr);
+    if(!s->csent[nn])
+    {
+      // the first node to begin a repetition starts it
+      r = tag / s->coll_steps;
+      if(c==0 && s->crep_start[r]<0) s->crep_start[r]=s->st;
+      for(j=0;j<m;j++) coll_send(s,nn,to[j],tag);
+      s->csent[nn]=1;
+      if( (el = from_l2(&s->cearly[nn],&tag,coll_find_content)) != NULL )
+      {
+        s->crecv[nn]+=((struct coll_early *)el->content)->cnt;
+        free(el);
+      }
+    }
+    if(s->crecv[nn] < nr) return;
+    s->cstep[nn]++;
+    s->crecv[nn]=0;
+    s->csent[nn]=0;
+    if(c==s->coll_steps-1)
+    {
+      r = tag / s->coll_steps;
+      if(++s->crep_done[r] == s->n_nodes)
+      {
+        s->crep_time[r]=s->st;
+        // the run ends with the last repetition
+        if(--s->coll_left == 0) s->max_st=s->st;
+
+if(s->dbg>0)
+{
+printf("collective repetition %d completed at %ld\n",r,s->st);
+}
+      }
+    }
+  }
+} /* coll_advance */
+
+void coll_recv(struct ts_sim *s, int nn, int tag)
+{
+  struct l2 *el;
+  struct coll_early *ce;
+
+  if(tag == s->cstep[nn])
+  {
+    s->crecv[nn]++;
+    coll_advance(s,nn);
+    return;
+  }
+  for(el=s->cearly[nn]; el!=NULL; el=(el->next==s->cearly[nn])?NULL:el->next)
+  {
+    ce=(struct coll_early *)el->content;
+    if(ce->tag==tag) {ce->cnt++; return;}
+  }
+  el = malloc(sizeof(struct l2)+sizeof(struct coll_early));
+  if( el==NULL ) error_exit("no memory for collectives");
+  ce = (struct coll_early *)(el+1);
+  el->content = ce;
+  ce->tag = tag;
+  ce->cnt = 1;
+  in_l2_tail(&s->cearly[nn],el);
+} /* coll_recv */
+
+void coll_init(struct ts_sim *s)
+{
+  int nn;
+
+  if(s->engine!='e' || s->model!='s' || s->nranks>1) error_exit("collectives are simulated by the event engine in one process");
+  s->coll_steps = coll_steps(s);
+  if(s->coll_steps==0) error_exit("collective of one node");
+  if(s->coll=='d' && (1<<s->coll_steps)!=s->n_nodes) error_exit("recursive doubling needs a power of 2 nodes");
+  s->cstep = calloc(s->n_nodes,sizeof(int));
+  s->crecv = calloc(s->n_nodes,sizeof(int));
+  s->csent = calloc(s->n_nodes,sizeof(char));
+  s->cearly = calloc(s->n_nodes,sizeof(struct l2 *));
+  s->crep_done = calloc(s->coll_reps,sizeof(int));
+  s->crep_start = malloc(s->coll_reps*sizeof(simtime));
+  s->crep_time = calloc(s->coll_reps,sizeof(simtime));
+  if( s->cstep==NULL || s->crecv==NULL || s->csent==NULL || s->cearly==NULL ||
+      s->crep_done==NULL || s->crep_start==NULL || s->crep_time==NULL ) error_exit("no memory for collectives");
+  for(nn=0;nn<s->coll_reps;nn++) s->crep_start[nn]=-1;
+  s->coll_left = s->coll_reps;
+  // no poisson injections
+  s->inj.t1 = s->max_st+1;
+  for(nn=0;nn<s->n_nodes;nn++) coll_advance(s,nn);
+} /* coll_init */
+
+///////////////////////////////////// traffic classes
+
+// a queued packet has an entry in the FIFO of its class at each of its
+// productive ports, so a free port takes the head of a FIFO instead of
+// scanning the node queue; the entries at other ports become stale when the
+// packet leaves the queue (qseq changes) and are dropped when they reach
+// the head
+
+struct cq_ref {
+  struct l2 * pkt;
+  long seq;
+};
+
+void class_init(struct ts_sim *s)
+{
+  int j, c, n=s->n_nodes*s->n_class*s->n_ports;
+
+  if(s->engine!='e' || s->model!='s' || s->nranks>1) error_exit("traffic classes are simulated by the event engine in one process");
+  if(s->coll) error_exit("traffic classes replace the poisson traffic of collectives");
+  for(c=0;c<s->n_class;c++)
+    for(j=0;j<s->d && s->cls[c].pattern=='t';j++)
+      if(s->kk[j]!=s->kk[s->d-1-j]) error_exit("transpose pattern needs symmetric sizes");
+  s->cstat=calloc(s->n_class,sizeof(struct ts_stat));
+  s->cq_head=calloc(n,sizeof(struct l2 *));
+  s->cq_tail=calloc(n,sizeof(struct l2 *));
+  if( s->cstat==NULL || s->cq_head==NULL || s->cq_tail==NULL ) error_exit("no memory for classes");
+  if(s->arb=='w')
+  {
+    s->wrr_cls=calloc(s->n_nodes*s->n_ports,sizeof(int));
+    s->wrr_credit=malloc(s->n_nodes*s->n_ports*sizeof(int));
+    if( s->wrr_cls==NULL || s->wrr_credit==NULL ) error_exit("no memory for classes");
+    for(j=0;j<s->n_nodes*s->n_ports;j++) s->wrr_credit[j]=s->cls[0].weight;
+  }
+} /* class_init */
+
+// class of a packet, with probability proportional to the class rates
+int class_pick(struct ts_sim *s)
+{
+  double u = rand_r(&s->rng_cls) / (RAND_MAX + 1.0) * s->lambda;
+  int c;
+
+  for(c=0;c<s->n_class-1 && u>=s->cls[c].lambda;c++) u-=s->cls[c].lambda;
+  return c;
+} /* class_pick */
+
+// destination of the pattern of class c, the uniform dst where the pattern
+// maps the source to itself
+int class_dest(struct ts_sim *s, int c, int src, int dst)
+{
+  int j, np, m, d=s->d, i[d], ii[d], nb[s->n_ports];
+  int pat=s->cls[c].pattern;
+
+  if(pat=='u') return dst;
+  if(pat=='h') return (src!=0)?0:dst;
+  node_index(src,i,d,s->kk);
+  if(pat=='n')
+  {
+    for(np=m=0;np<s->n_ports;np++)
+    {
+      if(topo_boundary(s,i,np)) continue;
+      node_hop(s,i,ii,np);
+      if((nb[m]=node_number(ii,d,s->kk))!=src) m++;
+    }
+    return (m>0)?nb[rand_r(&s->rng_cls)%m]:dst;
+  }
+  for(j=0,np=0;j<d;j++) np=np*s->kk[j]+((pat=='t')?i[d-1-j]:s->kk[j]-1-i[j]);
+  return (np!=src)?np:dst;
+} /* class_dest */
+
+// entries of a packet not switched at node nn
+void cq_push(struct ts_sim *s, int nn, struct l2 *pl2)
+{
+  struct packet *p=(struct packet *)pl2->content;
+  struct l2 *e;
+  struct cq_ref *r;
+  int j, c, m=0, d=s->d, i[d], ports[s->n_ports];
+
+  if(p->dports!=0) { for(j=0;j<s->n_ports;j++) if((p->dports>>j)&1) ports[m++]=j; }
+  else if(s->cand!=NULL)
+  {
+    node_index(nn,i,d,s->kk);
+    for(c=s->cand_start[p->dix];c<s->cand_start[p->dix+1];c++)
+      if(s->wrap_spec==NULL || !topo_boundary(s,i,s->cand[c])) ports[m++]=s->cand[c];
+  }
+  else for(j=0;j<d;j++) if(p->da[j]!=0) ports[m++]=port_number(j,SIGN(p->da[j]));
+  p->qseq=++s->cq_seq;
+  for(j=0;j<m;j++)
+  {
+    e=pool_alloc(&s->cq_pool,sizeof(struct l2)+sizeof(struct cq_ref));
+    r=(struct cq_ref *)e->content;
+    r->pkt=pl2;
+    r->seq=p->qseq;
+    e->next=NULL;
+    c=(nn*s->n_class+p->cls)*s->n_ports+ports[j];
+    if(s->cq_head[c]==NULL) s->cq_head[c]=e;
+    else s->cq_tail[c]->next=e;
+    s->cq_tail[c]=e;
+  }
+} /* cq_push */
+
+// live head entry of FIFO c, stale entries are released
+struct cq_ref * cq_head(struct ts_sim *s, int c)
+{
+  struct l2 *e;
+  struct cq_ref *r;
+
+  while( (e=s->cq_head[c]) != NULL )
+  {
+    r=(struct cq_ref *)e->content;
+    if(((struct packet *)r->pkt->content)->qseq==r->seq) return r;
+    s->cq_head[c]=e->next;
+    pool_free(&s->cq_pool,e);
+  }
+  return NULL;
+} /* cq_head */
+
+// removes the live head of FIFO c and its packet from the queue
+struct l2 * cq_pop(struct ts_sim *s, int c)
+{
+  struct l2 *e=s->cq_head[c], *pl2=((struct cq_ref *)e->content)->pkt;
+
+  s->cq_head[c]=e->next;
+  pool_free(&s->cq_pool,e);
+  ((struct packet *)pl2->content)->qseq=0;
+  return pl2;
+} /* cq_pop */
+
+// empties the FIFOs of node nn, returns its queued packets in FIFO order of
+// the ports
+struct l2 * cq_drain(struct ts_sim *s, int nn)
+{
+  struct l2 *e, *pl2, *q=NULL;
+  struct cq_ref *r;
+  int c, n=s->n_class*s->n_ports;
+
+  for(c=nn*n;c<(nn+1)*n;c++)
+  {
+    while( (e=s->cq_head[c]) != NULL )
+    {
+      r=(struct cq_ref *)e->content;
+      pl2=r->pkt;
+      if(((struct packet *)pl2->content)->qseq==r->seq)
+      {
+        ((struct packet *)pl2->content)->qseq=0;
+        in_l2_tail(&q,pl2);
+      }
+      s->cq_head[c]=e->next;
+      pool_free(&s->cq_pool,e);
+    }
+    s->cq_tail[c]=NULL;
+  }
+  return q;
+} /* cq_drain */
+
+// packet for the free port np of node nn by the class arbitration
+struct l2 * cq_take(struct ts_sim *s, int nn, int np)
+{
+  struct cq_ref *r;
+  int c, t, x, best=-1, C=s->n_class, P=s->n_ports, base=nn*C*P+np;
+  long seq=LONG_MAX;
+
+  switch(s->arb)
+  {
+  case 's':
+    for(c=0;c<C;c++) if(cq_head(s,base+c*P)!=NULL) return cq_pop(s,base+c*P);
+    return NULL;
+  case 'w':
+    x=nn*P+np;
+    for(t=0;t<=C;t++)
+    {
+      c=s->wrr_cls[x];
+      if(s->wrr_credit[x]>0 && cq_head(s,base+c*P)!=NULL)
+      {
+        s->wrr_credit[x]--;
+        return cq_pop(s,base+c*P);
+      }
+      s->wrr_cls[x]=(c+1)%C;
+      s->wrr_credit[x]=s->cls[s->wrr_cls[x]].weight;
+    }
+    return NULL;
+  default: // 'f'
+    for(c=0;c<C;c++)
+      if( (r=cq_head(s,base+c*P)) != NULL && r->seq<seq ) { seq=r->seq; best=c; }
+    return (best>=0)?cq_pop(s,base+best*P):NULL;
+  }
+} /* cq_take */
+
+// first queued packet that can take the free port np of node nn
+struct l2 * pkt_for_port(struct ts_sim *s, int nn, int np)
+{
+  struct port_key key;
+
+  if(s->cq_head!=NULL) return cq_take(s,nn,np);
+  key.np=np;
+  key.s=s;
+  return from_l2(&(s->n[nn].queue),&key,(s->cand!=NULL)?packet_find_nbh:packet_find_content);
+} /* pkt_for_port */
+
+///////////////////////////////////// distributed simulation
+
+int node_rank(struct ts_sim *s, int i0)
+{
+  return (long)i0*s->nranks/s->kk[0];
+} /* node_rank */
+
+// a channel to another rank: the packet is sent when transmission starts,
+// it arrives after serialisation and latency, not before the lookahead of
+// the ranks' windows
+void chan_start(struct ts_sim *s, struct l2 *pl2, int *i, int np)
+{
+  struct packet *p=(struct packet *)pl2->content;
+  int d=s->d, *k=s->kk, ii[d], r;
+  long *b;
+
+  if(s->nranks==1) return;
+  node_hop(s,i,ii,np);
+  r=node_rank(s,ii[0]);
+  if(r==s->rank) return;
+  if(s->scnt[r]>=s->scap[r])
+  {
+    s->scap[r]=(s->scap[r]==0)?64:2*s->scap[r];
+    s->sbuf[r]=realloc(s->sbuf[r],s->scap[r]*MPI_PKT_LONGS*sizeof(long));
+    if( s->sbuf[r]==NULL ) error_exit("no memory for send buffers");
+  }
+  b=s->sbuf[r]+s->scnt[r]*MPI_PKT_LONGS;
+  b[0]=s->st+chan_time(s,p,np)+s->lat[s->pdim[np]];
+  b[1]=node_number(ii,d,k);
+  b[2]=p->send_time;
+  b[3]=p->hops;
+  b[4]=node_number(p->source,d,k);
+  b[5]=node_number(p->dest,d,k);
+  b[6]=p->mis;
+  b[7]=p->back;
+  b[8]=p->size;
+  s->scnt[r]++;
+  s->sent_packets++;
+} /* chan_start */
+
+int chan_remote(struct ts_sim *s, int *ii)
+{
+  return s->nranks>1 && node_rank(s,ii[0])!=s->rank;
+} /* chan_remote */
+
+void in_pkt(struct ts_sim *s, struct l2 *pl2, int *i)
+{
+  struct packet *p=(struct packet *)pl2->content;
+  struct node *n=s->n;
+  struct ts_stat *t;
+  int nn, np, j, d=s->d;
+
+if(s->dbg>1)
+{
+printf("packet from (");
+for(j=0;j<d-1;j++) printf("%d,",(p->source)[j]);
+printf("%d) to (",(p->source)[d-1]);
+for(j=0;j<d-1;j++) printf("%d,",(p->dest)[j]);
+printf("%d) in %ld mtu entered (",(p->dest)[d-1],s->st-p->send_time);
+for(j=0;j<d-1;j++) printf("%d,",i[j]);
+printf("%d)\n",i[d-1]);
+}
+
+  nn = node_number(i,d,s->kk);
+  if(s->dead!=NULL && s->dead[nn])
+  {
+    s->stat.undeliverable_packets++;
+    if(s->cstat!=NULL) s->cstat[p->cls].undeliverable_packets++;
+    if(s->outstanding!=NULL) src_refill(s,p);
+    pkt_free(s,pl2);
+    return;
+  }
+
+  if(memcmp(i,p->dest,d*sizeof(int))==0)
+  {
+
+if(s->dbg>0)
+{
+printf("packet delivered from (");
+for(j=0;j<d-1;j++) printf("%d,",(p->source)[j]);
+printf("%d) to (",(p->source)[d-1]);
+for(j=0;j<d-1;j++) printf("%d,",(p->dest)[j]);
+printf("%d) in %ld mtu, %d hops\n",(p->dest)[d-1],s->st-p->send_time,p->hops);
+}
+    s->stat.delevered_packets++;
+    s->stat.delivered_bytes+=p->size;
+    s->stat.sum_of_hops+=p->hops;
+    s->stat.sum_of_packet_avg_chan_time+=((double)(s->st-p->send_time))/p->hops;
+    s->stat.sum_of_latency+=s->st-p->send_time;
+    if(s->cstat!=NULL)
+    {
+      t=s->cstat+p->cls;
+      t->delevered_packets++;
+      t->delivered_bytes+=p->size;
+      t->sum_of_hops+=p->hops;
+      t->sum_of_packet_avg_chan_time+=((double)(s->st-p->send_time))/p->hops;
+      t->sum_of_latency+=s->st-p->send_time;
+    }
+    if(s->cstep!=NULL) coll_recv(s,nn,p->tag);
+    if(s->outstanding!=NULL) src_recv(s,nn,p);
+    pkt_free(s,pl2);
+    return;
+  }
+
+  if(s->pc!=NULL) ts_perf_begin(s->pc,TS_PERF_SW);
+  np=sw_pkt(s,p,i,&s->rng_sw);
+  if(s->pc!=NULL) ts_perf_end(s->pc,TS_PERF_SW);
+  if(np==SW_LOST)
+  {
+
+if(s->dbg>0)
+{
+printf("packet undeliverable at node %d\n",nn);
+}
+    s->stat.undeliverable_packets++;
+    if(s->cstat!=NULL) s->cstat[p->cls].undeliverable_packets++;
+    if(s->outstanding!=NULL) src_refill(s,p);
+    pkt_free(s,pl2);
+    return;
+  }
+  (p->hops)++;
+
+if(s->dbg>1)
+{
+printf("switched to port %d at node %d\n",np,nn);
+}
+
+  if(np<0) // if not switched
+  {
+
+if(s->dbg>1)
+{
+printf("***packet goes to queue\n");
+}
+    if(n[nn].qb+p->size <= s->bl)
+    {
+      if(s->cq_head!=NULL) cq_push(s,nn,pl2);
+      else in_l2_tail(&(n[nn].queue),pl2);
+      (n[nn].nq)++;
+      n[nn].qb+=p->size;
+      s->stat.queued_packets++;
+      if(s->cstat!=NULL) s->cstat[p->cls].queued_packets++;
+    }
+    else
+    {
+      s->stat.dropped_packets++;
+      if(s->cstat!=NULL) s->cstat[p->cls].dropped_packets++;
+      if(s->outstanding!=NULL) src_refill(s,p);
+      pkt_free(s,pl2);
+    }
+  }
+  else
+  {
+    // start transmitting packet in port np
+    n[nn].port_pkt[np]=pl2;
+    chan_start(s,pl2,i,np);
+
+if(s->dbg>1)
+{
+printf("***packet goes to channel\n");
+}
+
+    // add packet finish transmitting event
+    add_event(s,s->st+chan_time(s,p,np),i,np,NULL);
+  }
+} /* in_pkt */
+
+void process_event_gen_pkt( struct ts_sim *s, int src, int dst )
+{
+  struct packet *p;
+  struct l2 * pl2;
+
+if(s->dbg>1)
+{
+printf("process_event_gen_pkt\n");
+}
+  if(s->dead!=NULL && s->dead[src]) return;
+
+  // generate a packet
+  pl2 = pkt_alloc(s);
+  p = (struct packet *)pl2->content;
+  p->send_time=s->st;
+  p->hops=0;
+  p->mis=0;
+  p->back=-1;
+  p->dports=0;
+  p->cls=0;
+  p->qseq=0;
+  if(s->cstat!=NULL)
+  {
+    p->cls=class_pick(s);
+    dst=class_dest(s,p->cls,src,dst);
+    s->cstat[p->cls].generated_packets++;
+  }
+  p->size=(s->cstat!=NULL && s->cls[p->cls].size>0)?s->cls[p->cls].size:pkt_size(s);
+  node_index(src,p->source,s->d,s->kk);
+  node_index(dst,p->dest,s->d,s->kk);
+  s->stat.generated_packets++;
+
+  in_pkt(s,pl2,p->source);
+} /* process_event_gen_pkt */
+
+void process_event_free_chan( struct ts_sim *s, struct l2 *el2 )
+{
+  struct event *e=(struct event *)el2->content;
+  struct packet *p;
+  struct l2 *pl2;
+  struct node *n=s->n;
+  int np, nn, j, d=s->d;
+  int *i=e->i, ii[d];
+
+if(s->dbg>1)
+{
+printf("process_event_free_chan\n");
+}
+
+  // get node, port numbers
+  nn = node_number(i,d,s->kk);
+  np = e->np;
+
+  // move transmitted packet to the next hop
+  pl2 = n[nn].port_pkt[np];
+if(s->dbg>1)
+{
+printf("node=%d, port=%d\n",nn,np);
+}
+  p=(struct packet *)(pl2->content);
+  s->stat.chan_work_time+=chan_time(s,p,np);
+  if(s->cstat!=NULL) s->cstat[p->cls].chan_work_time+=chan_time(s,p,np);
+
+if(s->dbg>1)
+{
+printf("packet from (");
+for(j=0;j<d-1;j++) printf("%d,",(p->source)[j]);
+printf("%d) to (",(p->source)[d-1]);
+for(j=0;j<d-1;j++) printf("%d,",(p->dest)[j]);
+printf("%d) in %ld mtu freed channel %d in (",(p->dest)[d-1],s->st-p->send_time,np);
+for(j=0;j<d-1;j++) printf("%d,",i[j]);
+printf("%d)\n",i[d-1]);
+}
+
+  n[nn].port_pkt[np]=NULL;
+  node_hop(s,i,ii,np);
+  if(chan_remote(s,ii)) pkt_free(s,pl2); // already sent
+  else if(s->lat[s->pdim[np]]>0) add_event(s,s->st+s->lat[s->pdim[np]],ii,-1,pl2); // on the wire
+  else in_pkt(s,pl2,ii);
+
+  // start next packet transmission on np
+  if( (s->alive==NULL || (s->alive[nn]>>np)&1) &&
+      (pl2 = pkt_for_port(s,nn,np) ) != NULL )
+  {
+if(s->dbg>0)
+{
+printf("***packet goes from queue\n");
+}
+    p=(struct packet *)(pl2->content);
+    if(p->dports!=0)
+    {
+      p->dports=0;
+      p->back=np^1;
+      p->mis++;
+      s->stat.misrouted_hops++;
+    }
+    (n[nn].nq)--;
+    n[nn].qb-=p->size;
+    s->stat.queued_packets--;
+    if(s->cstat!=NULL) s->cstat[p->cls].queued_packets--;
+    n[nn].port_pkt[np]=pl2;
+    chan_start(s,pl2,i,np);
+    e->at = s->st+chan_time(s,p,np);
+    in_l2_order(&s->eq,el2,event_compare_content);
+  }
+  else pool_free(&s->ev_pool,el2);
+} /* process_event_free_chan */
+
+void process_event_arrival( struct ts_sim *s, struct l2 *el2 )
+{
+  struct event *e=(struct event *)el2->content;
+
+if(s->dbg>1)
+{
+printf("process_event_arrival\n");
+}
+  in_pkt(s,e->pkt,e->i);
+  pool_free(&s->ev_pool,el2);
+} /* process_event_arrival */
+
+
+///////////////////////////////////// faults
+
+int fault_compare(const void *x1, const void *x2)
+{
+  const struct ts_fault *f1=(const struct ts_fault *)x1, *f2=(const struct ts_fault *)x2;
+  if(f1->at < f2->at) return -1;
+  else if(f1->at > f2->at) return 1;
+  else return 0;
+} /* fault_compare */
+
+void fault_add(struct ts_sim *s, simtime at, int nn, int np)
+{
+  if((s->n_fault & (s->n_fault-1))==0)
+  {
+    s->fault=realloc(s->fault,(s->n_fault==0?1:2*s->n_fault)*sizeof(struct ts_fault));
+    if( s->fault==NULL ) error_exit("no memory for faults");
+  }
+  s->fault[s->n_fault].at=at;
+  s->fault[s->n_fault].node=nn;
+  s->fault[s->n_fault].np=np;
+  s->n_fault++;
+} /* fault_add */
+
+// --faults=rate: each link is dead with the probability rate;
+// --faults=file: lines "link i0,i1,... m r [time]" (port (m,r) of node i)
+// or "node i0,i1,... [time]", # comments
+void fault_read(struct ts_sim *s, unsigned int seed)
+{
+  int j, nn, m, r, c, d=s->d, *k=s->kk, i[d];
+  double rate;
+  char *e, line[1024], kind[16], adr[256], *a;
+  long at;
+  FILE *f;
+
+  rate=strtod(s->faults,&e);
+  if(e!=s->faults && *e==0)
+  {
+    for(nn=0;nn<s->n_nodes;nn++)
+      for(j=0;j<d;j++)
+        if(rand_r(&seed)/(RAND_MAX+1.0) < rate) fault_add(s,0,nn,port_number(j,1));
+  }
+  else
+  {
+    f=fopen(s->faults,"r");
+    if( f==NULL ) error_exit("cannot open fault file");
+    while(fgets(line,sizeof(line),f)!=NULL)
+    {
+      if(sscanf(line,"%15s %255s",kind,adr)!=2 || kind[0]=='#') continue;
+      for(j=0,a=adr;j<d;j++)
+      {
+        i[j]=strtol(a,&e,10);
+        if(e==a || i[j]<0 || i[j]>=k[j]) error_exit("fault file: wrong node address");
+        a=(*e==',')?e+1:e;
+      }
+      nn=node_number(i,d,k);
+      at=0;
+      if(strcmp(kind,"link")==0)
+      {
+        c=sscanf(line,"%*s %*s %d %d %ld",&m,&r,&at);
+        if(c<2 || m<0 || m>=d || (r!=-1 && r!=1)) error_exit("fault file: wrong link");
+        fault_add(s,at,nn,port_number(m,r));
+      }
+      else if(strcmp(kind,"node")==0)
+      {
+        sscanf(line,"%*s %*s %ld",&at);
+        fault_add(s,at,nn,-1);
+      }
+      else error_exit("fault file: unknown fault");
+    }
+    fclose(f);
+  }
+  qsort(s->fault,s->n_fault,sizeof(struct ts_fault),fault_compare);
+} /* fault_read */
+
+void fault_link(struct ts_sim *s, int nn, int np)
+{
+  int d=s->d, i[d], ii[d], nb;
+
+  if(((s->alive[nn]>>np)&1)==0) return;
+  node_index(nn,i,d,s->kk);
+  if(topo_boundary(s,i,np)) return;
+  next_hop(i,ii,np,d,s->kk);
+  nb=node_number(ii,d,s->kk);
+  s->alive[nn]&=~(1u<<np);
+  s->alive[nb]&=~(1u<<(np^1));
+  s->n_dead_links++;
+} /* fault_link */
+
+// a dead node loses its links and the queued packets (also of the class
+// FIFOs), packets in channels are transmitted
+void fault_apply(struct ts_sim *s, struct ts_fault *f)
+{
+  struct l2 *pl2, *q;
+  struct packet *p;
+  int np, nn=f->node;
+
+if(s->dbg>0)
+{
+printf("fault at %ld: node %d, port %d\n",f->at,nn,f->np);
+}
+  if(f->np>=0) { fault_link(s,nn,f->np); return; }
+  if(s->dead[nn]) return;
+  s->dead[nn]=1;
+  s->n_dead_nodes++;
+  for(np=0;np<s->n_ports;np++) fault_link(s,nn,np);
+  if(nn<s->node_lo || nn>=s->node_hi) return;
+  q=(s->cq_head!=NULL)?cq_drain(s,nn):s->n[nn].queue;
+  s->n[nn].queue=NULL;
+  while( (pl2 = from_l2_head(&q)) != NULL )
+  {
+    p=(struct packet *)pl2->content;
+    s->n[nn].nq--;
+    s->n[nn].qb-=p->size;
+    s->stat.queued_packets--;
+    s->stat.undeliverable_packets++;
+    if(s->cstat!=NULL)
+    {
+      s->cstat[p->cls].queued_packets--;
+      s->cstat[p->cls].undeliverable_packets++;
+    }
+    pkt_free(s,pl2);
+  }
+} /* fault_apply */
+
+// detour ports of a blocked port np of node nn: its live ports of the next
+// dimensions in turn, positive direction first, ending with DETOUR_END
+void fault_detours(struct ts_sim *s)
+{
+  int nn, np, c, r, q, n, d=s->d, P=s->n_ports;
+  unsigned char *dt;
+
+  for(nn=0;nn<s->n_nodes;nn++)
+  {
+    for(np=0;np<P;np++)
+    {
+      dt=s->detour+(nn*P+np)*P;
+      for(c=1,n=0;c<=d;c++)
+        for(r=1;r>=-1;r-=2)
+        {
+          q=port_number((PORT_DIMENSION(np)+c)%d,r);
+          if((s->alive[nn]>>q)&1) dt[n++]=q;
+        }
+      if(n<P) dt[n]=DETOUR_END;
+    }
+  }
+} /* fault_detours */
+
+// apply faults up to the simulation time, switch queued packets (also of
+// the class FIFOs) again
+void fault_events(struct ts_sim *s)
+{
+  struct l2 *q, *pl2;
+  struct packet *p;
+  int nn, nq, d=s->d, i[d];
+
+  if(s->fault_pos>=s->n_fault || s->fault[s->fault_pos].at>s->st) return;
+  while(s->fault_pos<s->n_fault && s->fault[s->fault_pos].at<=s->st)
+    fault_apply(s,s->fault+s->fault_pos++);
+  fault_detours(s);
+  if(!s->ready) return;
+  for(nn=s->node_lo;nn<s->node_hi;nn++)
+  {
+    if(s->n[nn].nq==0) continue;
+    q=(s->cq_head!=NULL)?cq_drain(s,nn):s->n[nn].queue;
+    nq=s->n[nn].nq;
+    s->n[nn].queue=NULL;
+    s->n[nn].nq=0;
+    s->n[nn].qb=0;
+    s->stat.queued_packets-=nq;
+    node_index(nn,i,d,s->kk);
+    while( (pl2 = from_l2_head(&q)) != NULL )
+    {
+      p=(struct packet *)pl2->content;
+      if(s->cstat!=NULL) s->cstat[p->cls].queued_packets--;
+      p->hops--;
+      in_pkt(s,pl2,i);
+    }
+  }
+} /* fault_events */
+
+void fault_init(struct ts_sim *s, unsigned int seed)
+{
+  int nn, np, d=s->d, i[d];
+
+  if(s->faults==NULL) return;
+  if(s->engine!='e' || s->model!='s') error_exit("faults are simulated by the event engine");
+  if(s->cand!=NULL) error_exit("faults are simulated in the von Neumann neighbourhood of radius 1");
+  if(s->n_ports>32) error_exit("faults: too many ports");
+  s->all_ports=(s->n_ports==32)?~0u:(1u<<s->n_ports)-1;
+  s->alive=malloc(s->n_nodes*sizeof(unsigned int));
+  s->dead=calloc(s->n_nodes,1);
+  s->detour=malloc((size_t)s->n_nodes*s->n_ports*s->n_ports);
+  if( s->alive==NULL || s->dead==NULL || s->detour==NULL ) error_exit("no memory for faults");
+  for(nn=0;nn<s->n_nodes;nn++)
+  {
+    // mesh boundary ports are dead
+    s->alive[nn]=s->all_ports;
+    node_index(nn,i,d,s->kk);
+    for(np=0;np<s->n_ports;np++) if(topo_boundary(s,i,np)) s->alive[nn]&=~(1u<<np);
+  }
+  fault_read(s,seed);
+  fault_events(s);
+  fault_detours(s);
+} /* fault_init */
+
+///////////////////////////////////// analytic model
+
+struct model_est {
+  double hops;  // mean hops per packet
+  double nz;    // mean number of nonzero coordinate differences
+  double rho;   // channel utilisation
+  double wq;    // M/D/1 waiting time per hop
+  double wait;  // waiting time per hop for the rule
+  double thr;   // delivered packets per mtu
+};
+
+// mean hops from the exact distance distribution of the torus (a sum of d
+// independent per-dimension shortest distances, source excluded), channel
+// utilisation from the flow balance, per hop M/D/1 queueing delay; rules d-f
+// wait only when all productive ports are busy, a heuristic reduces the wait
+// by rho^(m-1) for m=(nz+1)/2, the mean productive ports along a path that
+// corrects its nz dimensions one after another; the rules of a-c, and of
+// d-f, get the same estimate (their free port choices mix the orders of
+// the dimensions, simulated within about 1% of each other)
+void analytic_model(struct ts_sim *s, struct model_est *m)
+{
+  int j, t, d=s->d, tm=topo_distances(s,NULL,NULL);
+  double pt[tm+1], p0[d*(tm+1)];
+
+  topo_distances(s,pt,p0);
+  m->hops=0;
+  for(t=1;t<=tm;t++) m->hops+=t*pt[t];
+  m->hops/=1-pt[0];
+
+if(s->dbg>0)
+{
+printf("distance distribution:");
+for(t=0;t<=tm;t++) printf(" %le",pt[t]);
+printf("\n");
+}
+
+  m->nz = 0;
+  for(j=0;j<d;j++) m->nz+=1-p0[j*(tm+1)];
+  m->nz/=1-pt[0];
+  m->rho = s->lambda*m->hops*s->cht*s->n_nodes/s->n_chan;
+  m->wq = (m->rho<1) ? m->rho*s->cht/(2*(1-m->rho)) : HUGE_VAL;
+  if(s->rule>='d' && s->rule<='f') m->wait = m->wq*pow(m->rho,(m->nz+1)/2-1);
+  else m->wait = m->wq;
+  m->thr = s->n_nodes*s->lambda;
+  if(m->rho>1) m->thr/=m->rho;
+} /* analytic_model */
+
+// statistics of the estimate over [0,max_st] in the simulation counters;
+// a saturated torus delivers the channel capacity, the excess is dropped
+void model_statistics(struct ts_sim *s, struct model_est *m)
+{
+  struct ts_stat *t = &s->stat;
+
+  s->st=s->max_st;
+  t->generated_packets=s->n_nodes*s->lambda*s->st;
+  t->delevered_packets=m->thr*s->st;
+  t->queued_packets=0;
+  t->dropped_packets=t->generated_packets-t->delevered_packets;
+  t->chan_work_time=m->thr*m->hops*s->cht*s->st;
+  t->sum_of_hops=m->hops*t->delevered_packets;
+  t->sum_of_packet_avg_chan_time=(s->cht+m->wait)*t->delevered_packets;
+  t->sum_of_latency=(s->cht+m->wait)*m->hops*t->delevered_packets;
+} /* model_statistics */
+
+///////////////////////////////////// time series statistics
+
+double wall_time()
+{
+  struct timeval tv;
+  gettimeofday(&tv,NULL);
+  return tv.tv_sec+tv.tv_usec*1e-6;
+} /* wall_time */
+
+void stats_open(struct ts_sim *s)
+{
+  char hdr[]="t,throughput,offered,util,mean_q,max_q,drop_rate,ev_rate\n";
+
+  s->rec_prev=s->stat;
+  s->rec_prev.st=0;
+  s->rec_wall=wall_time();
+  s->rec_next=s->stats_interval;
+  if(s->rank!=0) return;
+  s->rec_out=ts_stream_open((s->stats_file!=NULL)?s->stats_file:"-",REC_BUF);
+  if( s->rec_out==NULL ) error_exit("cannot open statistics file");
+  if(s->stats_format=='c') ts_stream_put(s->rec_out,hdr,strlen(hdr));
+} /* stats_open */
+
+// record of the interval since the previous record ending at t: rates of
+// the counters' increments, queue lengths are sampled at t;
+// the tail of the run shorter than a transfer is not recorded
+void stats_record(struct ts_sim *s, simtime t, int tail)
+{
+  struct ts_stat *c=&s->stat, *p=&s->rec_prev;
+  struct ts_rec r;
+  double v[7], dt=t-s->rec_prev.st, w;
+  int nn;
+  char line[256];
+
+  if(t <= p->st || (tail && t-p->st <= s->cht)) return;
+  v[0]=c->generated_packets-p->generated_packets;
+  v[1]=c->delevered_packets-p->delevered_packets;
+  v[2]=c->dropped_packets-p->dropped_packets;
+  v[3]=c->chan_work_time-p->chan_work_time;
+  v[4]=c->n_events-p->n_events;
+  v[5]=c->queued_packets;
+  v[6]=0;
+  for(nn=s->node_lo;nn<s->node_hi;nn++) if(s->n[nn].nq>v[6]) v[6]=s->n[nn].nq;
+  *p=*c;
+  p->st=t;
+#ifdef TS_MPI
+  if(s->nranks>1)
+  {
+    double g[7];
+    MPI_Reduce(v,g,6,MPI_DOUBLE,MPI_SUM,0,MPI_COMM_WORLD);
+    MPI_Reduce(v+6,g+6,1,MPI_DOUBLE,MPI_MAX,0,MPI_COMM_WORLD);
+    memcpy(v,g,sizeof(v));
+  }
+#endif
+  if(s->rank!=0) return;
+
+  w=wall_time();
+  r.t=t;
+  r.throughput=v[1]/dt;
+  r.offered=v[0]/dt;
+  r.util=v[3]/(dt*s->n_chan);
+  r.mean_q=v[5]/s->n_nodes;
+  r.max_q=v[6];
+  r.drop_rate=(v[0]>0)?v[2]/v[0]:0;
+  r.ev_rate=(w>s->rec_wall)?v[4]/(w-s->rec_wall):0;
+  s->rec_wall=w;
+  if(s->stats_format=='b') ts_stream_put(s->rec_out,&r,sizeof(r));
+  else
+  {
+    nn=snprintf(line,sizeof(line),"%ld,%le,%le,%le,%le,%.0f,%le,%le\n",
+      t,r.throughput,r.offered,r.util,r.mean_q,r.max_q,r.drop_rate,r.ev_rate);
+    ts_stream_put(s->rec_out,line,nn);
+  }
+} /* stats_record */
+
+///////////////////////////////////// engines
+
+// process events and injections of the next simulation time before tw
+int run_event_time(struct ts_sim *s, simtime tw)
+{
+  struct l2 * el2;
+  simtime t;
+
+  // advance simulation time: the earliest of events and injections
+  t = next_injection(s);
+  if(s->eq!=NULL && ((struct event *)s->eq->content)->at < t)
+    t=((struct event *)s->eq->content)->at;
+  if(s->fault_pos<s->n_fault && s->fault[s->fault_pos].at < t)
+    t=s->fault[s->fault_pos].at;
+  if(t >= tw) return 0;
+  s->st = t;
+
+if(s->dbg>0)
+{
+printf("current time: %ld\n",s->st);
+}
+//getchar();
+
+  fault_events(s);
+
+  // process all events for simulation time
+  while(s->eq!=NULL && ((struct event *)s->eq->content)->at <= s->st)
+  {
+
+if(s->dbg>1)
+{
+printf("event queue\n");
+print_events(s);
+}
+    el2 = from_l2_head( &s->eq );
+    s->stat.n_events++;
+    if(((struct event *)el2->content)->np < 0)
+      process_event_arrival( s, el2 );
+    else
+    {
+      if(s->pc!=NULL) ts_perf_begin(s->pc,TS_PERF_FREE);
+      process_event_free_chan( s, el2 );
+      if(s->pc!=NULL) ts_perf_end(s->pc,TS_PERF_FREE);
+    }
+  }
+
+  // inject packets generated for simulation time
+  while(next_injection(s) <= s->st)
+  {
+    if(s->pc!=NULL) ts_perf_begin(s->pc,TS_PERF_GEN);
+    process_event_gen_pkt( s, s->inj.src[s->inj.pos], s->inj.dst[s->inj.pos] );
+    if(s->pc!=NULL) ts_perf_end(s->pc,TS_PERF_GEN);
+    s->inj.pos++;
+    s->stat.n_events++;
+  }
+  return 1;
+} /* run_event_time */
+
+#ifdef TS_MPI
+
+// exchange packets sent within the window, they arrive not before its end
+void mpi_exchange(struct ts_sim *s)
+{
+  int r, c, nr, ns, nranks=s->nranks;
+  int *rcnt, *sdis, *rdis, *sc;
+  long *b;
+  struct l2 *pl2;
+  struct packet *p;
+  int i[s->d];
+  double t0=MPI_Wtime();
+
+  if(s->xcnt==NULL)
+  {
+    s->xcnt=malloc(4*nranks*sizeof(int));
+    if( s->xcnt==NULL ) error_exit("no memory for exchange");
+  }
+  rcnt=s->xcnt; sdis=rcnt+nranks; rdis=sdis+nranks; sc=rdis+nranks;
+  MPI_Alltoall(s->scnt,1,MPI_INT,rcnt,1,MPI_INT,MPI_COMM_WORLD);
+  for(r=0,nr=0,ns=0;r<nranks;r++)
+  {
+    sc[r]=s->scnt[r]*MPI_PKT_LONGS;
+    sdis[r]=ns;
+    ns+=sc[r];
+    rcnt[r]*=MPI_PKT_LONGS;
+    rdis[r]=nr;
+    nr+=rcnt[r];
+  }
+  if(ns>s->xscap)
+  {
+    s->xscap=2*ns;
+    s->xsbuf=realloc(s->xsbuf,s->xscap*sizeof(long));
+    if( s->xsbuf==NULL ) error_exit("no memory for exchange");
+  }
+  for(r=0;r<nranks;r++) memcpy(s->xsbuf+sdis[r],s->sbuf[r],sc[r]*sizeof(long));
+  if(nr>s->xrcap)
+  {
+    s->xrcap=2*nr;
+    s->xrbuf=realloc(s->xrbuf,s->xrcap*sizeof(long));
+    if( s->xrbuf==NULL ) error_exit("no memory for exchange");
+  }
+  MPI_Alltoallv(s->xsbuf,sc,sdis,MPI_LONG,s->xrbuf,rcnt,rdis,MPI_LONG,MPI_COMM_WORLD);
+  for(r=0;r<nranks;r++) s->scnt[r]=0;
+  s->exch_time+=MPI_Wtime()-t0;
+  s->n_windows++;
+  s->recv_packets+=nr/MPI_PKT_LONGS;
+
+  for(c=0;c<nr;c+=MPI_PKT_LONGS)
+  {
+    b=s->xrbuf+c;
+    pl2 = pkt_alloc(s);
+    p = (struct packet *)pl2->content;
+    p->send_time=b[2];
+    p->hops=b[3];
+    node_index(b[4],p->source,s->d,s->kk);
+    node_index(b[5],p->dest,s->d,s->kk);
+    p->mis=b[6];
+    p->back=b[7];
+    p->size=b[8];
+    p->dports=0;
+    node_index(b[1],i,s->d,s->kk);
+    add_event(s,b[0],i,-1,pl2);
+  }
+} /* mpi_exchange */
+
+// conservative synchronous windows of the lookahead: events of a window
+// can only cause arrivals on other ranks after its end, an empty exchange
+// acts as the null message
+void run_mpi(struct ts_sim *s)
+{
+  simtime tw;
+
+  for(tw=s->lookahead; tw-s->lookahead<=s->max_st; tw+=s->lookahead)
+  {
+    while(run_event_time(s,(tw<=s->max_st)?tw:s->max_st+1));
+    mpi_exchange(s);
+    if(s->stats_interval>0 && tw>=s->rec_next && tw<=s->max_st)
+    {
+      stats_record(s,tw,0);
+      while(s->rec_next<=tw) s->rec_next+=s->stats_interval;
+    }
+  }
+  s->st=s->max_st+1;
+  if(s->stats_interval>0) stats_record(s,s->st,1);
+} /* run_mpi */
+
+// reduce counters to rank 0, print per rank work and exchange overhead
+void mpi_reduce_statistics(struct ts_sim *s, double wall)
+{
+  struct ts_stat *t = &s->stat;
+  long lc[8]={t->generated_packets,t->delevered_packets,t->queued_packets,t->dropped_packets,t->n_events,s->sent_packets,
+    t->undeliverable_packets,t->misrouted_hops}, gc[8];
+  double ld[5]={t->sum_of_hops,t->sum_of_packet_avg_chan_time,t->chan_work_time,t->delivered_bytes,t->sum_of_latency}, gd[5];
+  double rr[6]={s->node_hi-s->node_lo,t->n_events,s->sent_packets,s->recv_packets,wall,s->exch_time}, *ar=NULL, *a;
+  int r;
+
+  MPI_Reduce(lc,gc,8,MPI_LONG,MPI_SUM,0,MPI_COMM_WORLD);
+  MPI_Reduce(ld,gd,5,MPI_DOUBLE,MPI_SUM,0,MPI_COMM_WORLD);
+  if(s->rank==0)
+  {
+    ar=malloc(6*s->nranks*sizeof(double));
+    if( ar==NULL ) error_exit("no memory for statistics");
+  }
+  MPI_Gather(rr,6,MPI_DOUBLE,ar,6,MPI_DOUBLE,0,MPI_COMM_WORLD);
+  if(s->rank!=0) return;
+  t->generated_packets=gc[0]; t->delevered_packets=gc[1]; t->queued_packets=gc[2]; t->dropped_packets=gc[3];
+  t->undeliverable_packets=gc[6]; t->misrouted_hops=gc[7];
+  t->sum_of_hops=gd[0]; t->sum_of_packet_avg_chan_time=gd[1]; t->chan_work_time=gd[2]; t->delivered_bytes=gd[3]; t->sum_of_latency=gd[4];
+  printf("***** Distributed Simulation *****\n");
+  printf("ranks: %d, windows: %ld, events: %ld, packets between ranks: %ld\n",s->nranks,s->n_windows,gc[4],gc[5]);
+  // exchange time per window and per packet sent and received by the rank
+  for(r=0;r<s->nranks;r++)
+  {
+    a=ar+6*r;
+    printf("rank %d: nodes %.0f, events %.0f, sent %.0f, received %.0f, wall %le (s), exchange %le (s), %le (s) per window, "
+      "%le (s) per sent, %le (s) per received packet, %le (events/s)\n",
+      r,a[0],a[1],a[2],a[3],a[4],a[5],a[5]/s->n_windows,(a[2]>0)?a[5]/a[2]:0.0,(a[3]>0)?a[5]/a[3]:0.0,a[1]/a[4]);
+  }
+  printf("\n");
+  free(ar);
+} /* mpi_reduce_statistics */
+
+#endif
+
+// lockstep switching of a packet entered node nn at the step:
+// deliver, occupy a free port of the node or queue, node local state only
+void ls_in_pkt(struct ts_sim *s, struct l2 *pl2, int *i, int nn, long *delivered, long *queued, long *dropped, double *hops, double *ct, double *lt)
+{
+  struct packet *p=(struct packet *)pl2->content;
+  struct node *n=s->n;
+  int np;
+
+  if(memcmp(i,p->dest,s->d*sizeof(int))==0)
+  {
+    (*delivered)++;
+    *hops+=p->hops;
+    *ct+=((double)(s->st-p->send_time))/p->hops;
+    *lt+=s->st-p->send_time;
+#pragma omp critical(pkt_pool)
+    pkt_free(s,pl2);
+    return;
+  }
+  np=sw_pkt(s,p,i,s->ls_rng+nn);
+  (p->hops)++;
+  if(np>=0) n[nn].port_pkt[np]=pl2;
+  else if(n[nn].qb+p->size <= s->bl)
+  {
+    in_l2_tail(&(n[nn].queue),pl2);
+    (n[nn].nq)++;
+    n[nn].qb+=p->size;
+    (*queued)++;
+  }
+  else
+  {
+    (*dropped)++;
+#pragma omp critical(pkt_pool)
+    pkt_free(s,pl2);
+  }
+} /* ls_in_pkt */
+
+// time-stepped engine: every channel transfer takes exactly cht, so all
+// transfers start and finish on step boundaries st=s*cht; an injection
+// generated at t enters its node at the first boundary >= t
+void run_lockstep_step(struct ts_sim *s)
+{
+  struct l2 *pl2;
+  struct packet *p;
+  struct node *n=s->n;
+  int c, nn, sn, d=s->d, *k=s->kk, n_ports=s->n_ports, n_pc=s->n_nodes*n_ports;
+  long delivered, queued, dropped, busy;
+  double hops, ct, lt;
+
+if(s->dbg>0)
+{
+printf("current time: %ld\n",s->st);
+}
+  // quantised injections: packets generated until the step boundary
+  while(next_injection(s) <= s->st)
+  {
+    sn = s->inj.src[s->inj.pos];
+    pl2 = pkt_alloc(s);
+    p = (struct packet *)pl2->content;
+    p->send_time=s->inj.at[s->inj.pos];
+    p->hops=0;
+    p->mis=0;
+    p->back=-1;
+    p->dports=0;
+    p->size=1;
+    node_index(sn,p->source,d,k);
+    node_index(s->inj.dst[s->inj.pos],p->dest,d,k);
+    in_l2_tail(&(n[sn].inj),pl2);
+    s->stat.generated_packets++;
+    s->stat.sum_of_inj_delay+=s->st-p->send_time;
+    s->stat.n_events++;
+    s->inj.pos++;
+  }
+
+  // finished transfers move to the neighbors' input ports
+  busy=0;
+#pragma omp parallel for reduction(+:busy)
+  for(c=0;c<n_pc;c++)
+  {
+    if(s->port_pkt_all[c]!=NULL)
+    {
+      s->inbox[s->nbr[c]*n_ports+((c%n_ports)^1)]=s->port_pkt_all[c];
+      s->port_pkt_all[c]=NULL;
+      busy++;
+    }
+  }
+  s->stat.chan_work_time+=(double)busy*s->cht;
+
+  // nodes: refill ports from queues, switch arrived and injected packets;
+  // no error_exit fires in the loop (lockstep_init checks the rule, packets
+  // at their destination are delivered before switching), and debug output
+  // keeps its order on one thread
+  delivered=queued=dropped=0;
+  hops=ct=lt=0;
+#pragma omp parallel for reduction(+:delivered,queued,dropped,hops,ct,lt) schedule(static) if(s->dbg==0)
+  for(nn=0;nn<s->n_nodes;nn++)
+  {
+    int i[d], q;
+    struct l2 *ql2, **in = s->inbox+nn*n_ports;
+
+    node_index(nn,i,d,k);
+    for(q=0;q<n_ports;q++)
+    {
+      if( n[nn].port_pkt[q]==NULL && n[nn].queue!=NULL &&
+          (ql2 = pkt_for_port(s,nn,q)) != NULL )
+      {
+        (n[nn].nq)--;
+        n[nn].qb-=((struct packet *)ql2->content)->size;
+        queued--;
+        n[nn].port_pkt[q]=ql2;
+      }
+    }
+    for(q=0;q<n_ports;q++)
+    {
+      if(in[q]!=NULL)
+      {
+        ls_in_pkt(s,in[q],i,nn,&delivered,&queued,&dropped,&hops,&ct,&lt);
+        in[q]=NULL;
+      }
+    }
+    while( (ql2 = from_l2_head(&(n[nn].inj))) != NULL )
+      ls_in_pkt(s,ql2,i,nn,&delivered,&queued,&dropped,&hops,&ct,&lt);
+  }
+  s->stat.delevered_packets+=delivered;
+  s->stat.queued_packets+=queued;
+  s->stat.dropped_packets+=dropped;
+  s->stat.sum_of_hops+=hops;
+  s->stat.sum_of_packet_avg_chan_time+=ct;
+  s->stat.sum_of_latency+=lt;
+  s->stat.n_events+=busy;
+} /* run_lockstep_step */
+
+void lockstep_init(struct ts_sim *s)
+{
+  int nn, np, n_pc=s->n_nodes*s->n_ports, d=s->d, *k=s->kk, i[d], ii[d];
+
+  if(s->rule<'a' || s->rule>'f') error_exit("unknown switching rule");
+  s->inbox = calloc(n_pc,sizeof(struct l2 *));
+  s->nbr = malloc(n_pc*sizeof(int));
+  s->ls_rng = malloc(s->n_nodes*sizeof(unsigned int));
+  if( s->inbox==NULL || s->nbr==NULL || s->ls_rng==NULL ) error_exit("no memory for lockstep");
+  for(nn=0;nn<s->n_nodes;nn++)
+  {
+    s->ls_rng[nn] = rand_r(&s->rng_sw);
+    node_index(nn,i,d,k);
+    for(np=0;np<s->n_ports;np++)
+    {
+      node_hop(s,i,ii,np);
+      s->nbr[nn*s->n_ports+np]=node_number(ii,d,k);
+    }
+  }
+} /* lockstep_init */
+
+/////////////////////////////////////////////
+
+// allocate and init data of the configured torus
+// the next ts_sim_init of s takes over the packet and event pools, the node
+// arrays (same nodes and ports) and injection buffers of the finished old
+void ts_sim_reuse(struct ts_sim *s, struct ts_sim *old)
+{
+  if(s->spare!=NULL) ts_sim_destroy(s->spare);
+  s->spare = old;
+} /* ts_sim_reuse */
+
+void sim_adopt(struct ts_sim *s)
+{
+  struct ts_sim *o = s->spare;
+
+  s->spare = NULL;
+  pool_reuse(&s->pkt_pool,&o->pkt_pool,sizeof(struct l2)+sizeof(struct packet)+3*s->d*sizeof(int));
+  pool_reuse(&s->ev_pool,&o->ev_pool,sizeof(struct l2)+sizeof(struct event)+s->d*sizeof(int));
+  if(o->ready && o->n_nodes==s->n_nodes && o->n_ports==s->n_ports)
+  {
+    s->n = o->n; o->n = NULL;
+    s->next_gen = o->next_gen; o->next_gen = NULL;
+    s->port_pkt_all = o->port_pkt_all; o->port_pkt_all = NULL;
+    memset(s->port_pkt_all,0,s->n_nodes*s->n_ports*sizeof(struct l2 *));
+    s->gen_act = o->gen_act; o->gen_act = NULL;
+    s->gen_u = o->gen_u; o->gen_u = NULL;
+    s->gen_dt = o->gen_dt; o->gen_dt = NULL;
+  }
+  s->inj.at = o->inj.at;
+  s->inj.src = o->inj.src;
+  s->inj.dst = o->inj.dst;
+  s->inj.cap = o->inj.cap;
+  memset(&o->inj,0,sizeof(struct inj_buf));
+  s->gen_sort = o->gen_sort; o->gen_sort = NULL;
+  s->gen_sort_cap = o->gen_sort_cap;
+  ts_sim_destroy(o);
+} /* sim_adopt */
+
+void ts_sim_init(struct ts_sim *s)
+{
+  int *i, nn, j, d, *k;
+  unsigned int seed;
+
+  if(s->ready) return;
+  topo_init(s);
+  d=s->d;
+  k=s->kk;
+#ifdef TS_MPI
+  MPI_Initialized(&j);
+  if(j)
+  {
+    MPI_Comm_rank(MPI_COMM_WORLD,&s->rank);
+    MPI_Comm_size(MPI_COMM_WORLD,&s->nranks);
+  }
+#endif
+  seed = (s->seed!=0) ? s->seed : (unsigned)time(NULL);
+#ifdef TS_MPI
+  if(s->nranks>1) MPI_Bcast(&seed,1,MPI_UNSIGNED,0,MPI_COMM_WORLD); // the same faults
+#endif
+  s->rng_gen = seed+s->rank;
+  s->rng_sw = ~(seed+s->rank);
+  s->rng_size = seed*31+s->rank;
+  s->rng_cls = seed*17+s->rank;
+
+  // owned slab of the first coordinate
+  s->node_lo = (s->rank*k[0]+s->nranks-1)/s->nranks * (s->n_nodes/k[0]);
+  s->node_hi = ((s->rank+1)*k[0]+s->nranks-1)/s->nranks * (s->n_nodes/k[0]);
+  if(s->nranks>1)
+  {
+    if(s->engine!='e' || s->model!='s') error_exit("distributed simulation uses the event engine");
+    if(s->nranks>k[0]) error_exit("more ranks than torus size");
+    s->sbuf = calloc(s->nranks,sizeof(long *));
+    s->scnt = calloc(s->nranks,sizeof(int));
+    s->scap = calloc(s->nranks,sizeof(int));
+    if( s->sbuf==NULL || s->scnt==NULL || s->scap==NULL ) error_exit("no memory for send buffers");
+  }
+
+  if(s->spare!=NULL) sim_adopt(s);
+  if(s->n==NULL)
+  {
+    s->n = malloc(s->n_nodes* sizeof(struct node));
+    s->next_gen = malloc(s->n_nodes* sizeof(simtime));
+    s->port_pkt_all = calloc(s->n_nodes*s->n_ports, sizeof(struct l2 *));
+    s->gen_act = malloc(s->n_nodes*sizeof(int));
+    s->gen_u = malloc(s->n_nodes*sizeof(double));
+    s->gen_dt = malloc(s->n_nodes*sizeof(simtime));
+  }
+  if( s->n==NULL || s->next_gen==NULL || s->port_pkt_all==NULL ||
+      s->gen_act==NULL || s->gen_u==NULL || s->gen_dt==NULL ) error_exit("no memory for nodes");
+  if( s->lambda > 0 && INJ_BATCH / ((s->node_hi-s->node_lo)*s->lambda) < s->max_st )
+    s->gen_window = INJ_BATCH / ((s->node_hi-s->node_lo)*s->lambda) + 1;
+  else s->gen_window = s->max_st+1;
+
+  i = malloc(d*sizeof(int));
+  if( i==NULL ) error_exit("no memory for index");
+
+  init_index(i,d);
+
+  do
+  {
+    nn = node_number(i,d,k);
+    s->n[nn].queue = NULL;
+    s->n[nn].nq = 0;
+    s->n[nn].qb = 0;
+    s->n[nn].inj = NULL;
+    s->n[nn].port_pkt = s->port_pkt_all + nn*s->n_ports;
+
+if(s->dbg>1)
+{
+printf("init node (");
+for(j=0;j<d-1;j++) printf("%d,",i[j]);
+printf("%d)\n",i[d-1]);
+}
+//getchar();
+
+    // first packet generation time
+    s->next_gen[nn] = packet_interval(s->lambda,&s->rng_gen);
+
+  } while( next_index(i,d,k) );
+  free(i);
+
+  fault_init(s,seed);
+  if(!chan_uniform(s) && s->engine!='e')
+    error_exit("latency, bandwidth and packet sizes are simulated by the event engine");
+  if(s->engine=='l') lockstep_init(s);
+  if(s->coll) coll_init(s);
+  if(s->n_class>0) class_init(s);
+  if(s->src_kind!='p') src_init(s);
+  if(s->stats_interval>0) stats_open(s);
+  if(s->perf)
+  {
+    s->pc=ts_perf_open();
+    if( s->pc==NULL ) error_exit("no memory for performance counters");
+  }
+  s->st=0;
+  s->ready=1;
+} /* ts_sim_init */
+
+// simulate all activity before time until (or max_st), returns 0 at the end
+int ts_sim_step(struct ts_sim *s, simtime until)
+{
+  ts_sim_init(s);
+  if(until > s->max_st+1) until = s->max_st+1;
+  if(s->engine=='l')
+  {
+    // steps are at multiples of cht
+    while(s->st < until)
+    {
+      run_lockstep_step(s);
+      s->st+=s->cht;
+    }
+  }
+  else
+  {
+    while(run_event_time(s,until));
+    if(until > s->max_st+1) until = s->max_st+1; // a collective ended the run
+    if(s->st < until) s->st=until;
+  }
+  return s->st <= s->max_st;
+} /* ts_sim_step */
+
+// hybrid calibration run saturated: over its second half (from h to t)
+// the torus dropped packets, or its queues grew while it delivered less than
+// 98% of the generated packets; packets in flight at the end are not lost
+int cal_saturated(struct ts_stat *h, struct ts_stat *t)
+{
+  long gen = t->generated_packets-h->generated_packets;
+  long del = t->delevered_packets+t->undeliverable_packets-h->delevered_packets-h->undeliverable_packets;
+
+  if(t->dropped_packets>h->dropped_packets) return 1;
+  return del<0.98*gen && t->queued_packets>h->queued_packets;
+} /* cal_saturated */
+
+void ts_sim_run(struct ts_sim *s)
+{
+  struct model_est me;
+  struct ts_stat half;
+  simtime full_st=s->max_st;
+#ifdef TS_MPI
+  double wall;
+#endif
+
+  if(s->model!='s')
+  {
+    topo_init(s);
+    if(!chan_uniform(s)) error_exit("latency, bandwidth and packet sizes are simulated by the event engine");
+    if(s->cand!=NULL) error_exit("the models assume the von Neumann neighbourhood of radius 1");
+    if(s->src_kind!='p') error_exit("the models assume poisson sources");
+    analytic_model(s,&me);
+    if(s->model=='a' || me.rho<=HYBRID_RHO)
+    {
+      model_statistics(s,&me);
+      return;
+    }
+    // hybrid: calibrate the per hop waiting time by a short simulation
+    s->max_st=(s->cal_st>0)?s->cal_st:s->max_st/10;
+    s->cal_st=s->max_st;
+  }
+
+  ts_sim_init(s);
+  half=s->stat;
+  if(s->pc!=NULL) ts_perf_begin(s->pc,TS_PERF_MAIN);
+#ifdef TS_MPI
+  if(s->nranks>1)
+  {
+    wall=MPI_Wtime();
+    run_mpi(s);
+    mpi_reduce_statistics(s,MPI_Wtime()-wall);
+  }
+  else
+#endif
+  {
+    // time series: a record at the end of each interval
+    while(s->stats_interval>0 && s->rec_next<=s->max_st)
+    {
+      ts_sim_step(s,s->rec_next);
+      stats_record(s,s->st,0);
+      while(s->rec_next<=s->st) s->rec_next+=s->stats_interval;
+    }
+    if(s->model=='h')
+    {
+      ts_sim_step(s,s->max_st/2);
+      half=s->stat;
+    }
+    ts_sim_step(s,s->max_st+1);
+    if(s->stats_interval>0) stats_record(s,s->st,1);
+  }
+  if(s->pc!=NULL) ts_perf_end(s->pc,TS_PERF_MAIN);
+  ts_stream_close(s->rec_out);
+  s->rec_out=NULL;
+
+  if(s->model=='h')
+  {
+    // the measured wait replaces the estimate, an infinite one (rho>=1)
+    // has no factor
+    s->cal_done=1;
+    s->cal_wait=(s->stat.delevered_packets>0)?s->stat.sum_of_packet_avg_chan_time/s->stat.delevered_packets-s->cht:0;
+    s->cal=isfinite(me.wait)?s->cal_wait/me.wait:NAN;
+    me.wait=s->cal_wait;
+    // saturated before the model limit: throughput as calibrated
+    if(cal_saturated(&half,&s->stat)) me.thr=(double)s->stat.delevered_packets/s->st;
+    s->max_st=full_st;
+    model_statistics(s,&me);
+  }
+} /* ts_sim_run */
+
+void ts_sim_destroy(struct ts_sim *s)
+{
+  int r, nn;
+  struct l2 *el2;
+
+  if(s->spare!=NULL) ts_sim_destroy(s->spare);
+  pool_destroy(&s->pkt_pool);
+  pool_destroy(&s->ev_pool);
+  free(s->n);
+  free(s->next_gen);
+  free(s->port_pkt_all);
+  free(s->inbox);
+  free(s->nbr);
+  free(s->ls_rng);
+  free(s->gen_act);
+  free(s->gen_u);
+  free(s->gen_dt);
+  free(s->gen_sort);
+  free(s->inj.at);
+  free(s->inj.src);
+  free(s->inj.dst);
+  if(s->sbuf!=NULL) for(r=0;r<s->nranks;r++) free(s->sbuf[r]);
+  free(s->sbuf);
+  free(s->scnt);
+  free(s->scap);
+  free(s->xcnt);
+  free(s->xsbuf);
+  free(s->xrbuf);
+  ts_stream_close(s->rec_out);
+  free(s->stats_file);
+  free(s->faults);
+  free(s->ksz);
+  free(s->wrap_spec);
+  free(s->lat_spec);
+  free(s->bw_spec);
+  free(s->lat);
+  free(s->tpb);
+  free(s->kk);
+  free(s->wrap);
+  free(s->dtab);
+  free(s->dtab_c);
+  free(s->poff);
+  free(s->pdim);
+  free(s->cand_start);
+  free(s->cand);
+  free(s->cand_w);
+  free(s->fault);
+  free(s->alive);
+  free(s->dead);
+  free(s->detour);
+  ts_perf_close(s->pc);
+  if(s->cearly!=NULL)
+  {
+    for(nn=0;nn<s->n_nodes;nn++) while( (el2 = from_l2_head(&s->cearly[nn])) != NULL ) free(el2);
+  }
+  free(s->cstep);
+  free(s->crecv);
+  free(s->csent);
+  free(s->cearly);
+  free(s->crep_done);
+  free(s->crep_start);
+  free(s->crep_time);
+  free(s->cstat);
+  free(s->cq_head);
+  free(s->cq_tail);
+  pool_destroy(&s->cq_pool);
+  free(s->wrr_cls);
+  free(s->wrr_credit);
+  free(s->mstate);
+  free(s->mend);
+  free(s->outstanding);
+  free(s);
+} /* ts_sim_destroy */
+
+// ts_sim.c end
@@ -0,0 +1,313 @@
+// ts_sim.h
+// reentrant torus simulation context: library interface of ts (libts)
+
+#ifndef __TS_SIM__
+#define __TS_SIM__
+
+#include <stdio.h>
+#include <setjmp.h>
+
+#include "al2.h"
+#include "ts_stream.h"
+#include "ts_perf.h"
+
+#define N_OF_PORTS(d) (2*(d))
+#define PORT_DIMENSION(np) ((np) / 2)
+#define PORT_DIRECTION(np) (((np)%2==0)?-1:1)
+#define TORUS_NEIGHBOR(ij,dij,k) (((ij)+(dij)<0)?((k)-1):((ij)+(dij)>=(k))?0:(ij)+(dij))
+#define SIGN(x) (((x)<0)?-1:((x)>0)?1:0)
+#define ABS(x) (((x)<0)?-1*(x):(x))
+
+typedef long int simtime;
+
+#define TS_MAX_CLASS 8 // traffic classes
+
+// a traffic class: poisson sources of every node at lambda, class 0 has the
+// highest priority
+
+struct ts_class {
+  double lambda;
+  int size;    // bytes, 0: --size
+  int pattern; // destinations: 'u' uniform, 'n' neighbour, 't' transpose,
+               // 'c' complement, 'h' hotspot (node 0)
+  int weight;  // weighted round robin arbitration
+};
+
+struct packet {
+  int * source;
+  int * dest;
+  simtime send_time;
+  int hops;
+  int size;  // bytes
+  int *da;
+  int mis;   // faults: non-minimal hops taken
+  unsigned int dports; // faults: ports of a detour the packet waits for, 0 none
+  int back;  // faults: port back to the node before a detour, -1 none
+  int tag;   // collectives: step of the message
+  int dix;   // neighbourhoods: index of da in the port candidate table
+  int cls;   // traffic class
+  long qseq; // classes: indexed queue entries of the packet, 0 not queued
+  simtime req_time; // request/reply: send time of the request of a reply
+};
+
+struct node {
+  struct l2 * queue;
+  int nq;
+  long qb; // queued bytes
+  struct l2 ** port_pkt;
+  struct l2 * inj; // lockstep: packets injected at the current step
+};
+
+// events: (a) packet arrived from another rank np=-1; (b) channel became free np>=0;
+// packet generation is not an event, injections are taken from the pending injection buffer
+
+struct event {
+  simtime at;
+  int * i;
+  int np;
+  struct l2 * pkt; // arrived packet
+};
+
+// pending injections of a time window, structure of arrays sorted by time
+
+struct inj_buf {
+  int cnt;       // injections in the buffer
+  int pos;       // next injection to process
+  int cap;
+  simtime t1;    // end of the generated window
+  simtime *at;
+  int *src;
+  int *dst;
+};
+
+struct inj_rec {
+  simtime at;
+  int seq;
+  int src;
+  int dst;
+};
+
+// list elements with their content allocated in slabs, reused via free list
+
+struct pool {
+  struct l2 * free;
+  void ** slab;
+  int n_slab;
+  int cap_slab;
+  size_t size; // element size of the slabs
+};
+
+// a dead link (port np of node and the opposite port of its neighbor)
+// or a dead node (np=-1) from time at
+
+struct ts_fault {
+  simtime at;
+  int node;
+  int np;
+};
+
+struct ts_stat {
+  simtime st;
+  int n_chan;
+  long int generated_packets;
+  long int delevered_packets;
+  long int queued_packets;
+  long int dropped_packets;
+  double sum_of_hops;
+  double sum_of_packet_avg_chan_time;
+  double sum_of_latency; // delivered packets, generation to delivery
+  double chan_work_time;
+  double sum_of_inj_delay; // lockstep injection quantisation
+  long int n_events;
+  long int undeliverable_packets; // faults: lost at dead nodes or out of detours
+  long int misrouted_hops; // faults: non-minimal hops
+  double delivered_bytes;
+  long int completed_requests; // closed loop: round trips completed
+  double sum_of_rtt;
+};
+
+struct ts_sim {
+  // param
+  int d;
+  int k;
+  int * ksz; // --k=k0,k1,...: per dimension sizes, sets d
+  int n_ksz;
+  char * wrap_spec; // per dimension 1 torus, 0 mesh; one digit for all
+  int nbh; // neighbourhood: 'n' von Neumann, 'm' Moore
+  int radius; // neighbourhood radius, 1: nearest neighbours
+  int rule;
+  double lambda;
+  int cht;
+  int bl; // node buffer, bytes
+  char * lat_spec; // per dimension channel latency, mtu
+  char * bw_spec; // per dimension bandwidth, bytes per mtu
+  int size_kind; // packet sizes: 'f' fixed, 'u' uniform, 'b' bimodal, 'e' exponential
+  double size_a, size_b, size_p;
+  simtime max_st;
+  int engine;
+  int model;
+  simtime cal_st; // hybrid model calibration run time, default max_st/10
+  unsigned int seed; // 0: from time
+  simtime stats_interval; // 0: no time series
+  char * stats_file; // "-": standard output
+  int stats_format; // 'c' csv or 'b' binary
+  char * faults; // fault file or link fault rate
+  int max_mis; // faults: non-minimal hops allowed per packet
+  int perf; // hardware performance counters
+  int coll; // collective workload: 'r' ring, 'd' recursive doubling, 't' torus
+            // allreduce, 'a' alltoall, 'b' broadcast, 'h' halo exchange, 0 none
+  int coll_reps;
+  simtime coll_overhead; // from a step to the injection of its messages
+  struct ts_class cls[TS_MAX_CLASS]; // --class=..., replace --lambda
+  int n_class;
+  int arb; // class arbitration of a free port: 'f' oldest packet, 's' strict
+           // priority, 'w' weighted round robin
+  int src_kind; // sources: 'p' poisson, 'o' on/off, 'm' mmpp, 'c' closed
+                // loop, 'r' closed loop request/reply
+  double src_burst; // on/off, mmpp: mean packets per burst (high state)
+  double src_duty; // fraction of time in the high state
+  double src_ratio; // mmpp: high to low rate
+  int window; // closed loop: outstanding packets per node
+  double think; // closed loop: mean time before a new request
+  int dbg;
+
+  // var
+  int rank, nranks; // distributed simulation: rank owns slab of i[0]
+  int node_lo, node_hi; // owned node numbers
+  int n_nodes;
+  int n_ports;
+  int n_chan;
+  int * kk; // per dimension size
+  int * wrap; // per dimension wraparound
+  int * dtab; // per dimension shortest differences
+  int ** dtab_c; // dtab_c[j][x], x=id[j]-is[j]
+  int * poff; // port x dimension neighbour offsets, port np^1 opposite to np
+  int * pdim; // per port dimension of the channel latency and bandwidth
+  int * cand_start; // neighbourhoods: productive ports of a difference index,
+  int * cand; // cand[cand_start[x]..cand_start[x+1]-1] by decreasing progress,
+  int * cand_w; // rule c weights; NULL for the von Neumann neighbourhood
+  simtime * lat; // per dimension latency
+  double * tpb; // per dimension serialisation time per byte
+  simtime lookahead; // least time from transmission start to arrival
+  unsigned int rng_size; // packet sizes
+  int ready; // torus allocated
+  struct ts_sim * spare; // finished simulation whose storage ts_sim_init takes over
+  simtime st;
+  unsigned int rng_gen; // injection stream
+  unsigned int rng_sw; // switching decisions
+  struct l2 * eq;
+  struct node *n;
+  struct inj_buf inj;
+  struct inj_buf * trace; // injection stream replayed instead of generated, not owned
+  int trace_pos;
+  simtime *next_gen; // per node time of the next packet generation
+  simtime gen_window;
+  struct pool pkt_pool;
+  struct pool ev_pool;
+  struct l2 ** port_pkt_all; // flat node x port channel state
+  struct l2 ** inbox; // lockstep: node x port packets arrived at the step
+  int * nbr; // lockstep: node x port neighbor node numbers
+  unsigned int * ls_rng; // lockstep: per node switching random state
+  int * gen_act; // batch generation: nodes inside the window
+  double * gen_u;
+  simtime * gen_dt;
+  struct inj_rec * gen_sort;
+  int gen_sort_cap;
+  double cal; // hybrid model waiting time factor, NAN when the analytic wait is infinite
+  double cal_wait; // hybrid model measured waiting time per hop, mtu
+  int cal_done; // hybrid model calibration run made
+
+  // distributed simulation
+  long ** sbuf; // packets to send, per rank
+  int * scnt;
+  int * scap;
+  long int sent_packets; // to other ranks
+  long int recv_packets; // from other ranks
+  double exch_time;
+  long int n_windows;
+  int * xcnt; // exchange counts and displacements
+  long * xsbuf, * xrbuf;
+  int xscap, xrcap;
+
+  // faults
+  struct ts_fault * fault; // sorted by time
+  int n_fault, fault_pos;
+  unsigned int * alive; // per node bit mask of live ports
+  unsigned int all_ports;
+  char * dead; // per node
+  unsigned char * detour; // node x blocked port: live detour ports in order, rebuilt on faults
+  int n_dead_links, n_dead_nodes;
+
+  struct ts_perf * pc; // performance counters
+
+  // collectives
+  int coll_steps; // per repetition
+  int * cstep; // per node step, through the repetitions
+  int * crecv; // messages of the step received
+  char * csent; // messages of the step sent
+  struct l2 ** cearly; // messages of later steps, per node sparse list
+  int * crep_done; // nodes that completed a repetition
+  simtime * crep_start; // first step of a repetition begun by a node, -1 not yet
+  simtime * crep_time; // completion of a repetition
+  int coll_left; // repetitions not completed
+
+  // traffic classes
+  unsigned int rng_cls; // class and pattern draws
+  struct ts_stat * cstat; // per class
+  struct l2 ** cq_head; // node x class x port FIFOs of queued packets,
+  struct l2 ** cq_tail; // a packet in the FIFOs of all its productive ports
+  struct pool cq_pool;
+  long cq_seq;
+  int * wrr_cls; // node x port: class served and its credit left
+  int * wrr_credit;
+
+  // sources
+  double rate_hi, rate_lo; // on/off, mmpp: per node rates of the states
+  char * mstate; // per node state, 1 high
+  simtime * mend; // per node end of the state
+  int * outstanding; // closed loop: per node packets in flight
+
+  // time series statistics
+  struct ts_stream * rec_out;
+  struct ts_stat rec_prev; // counters at the previous record
+  double rec_wall;
+  simtime rec_next;
+
+  // stat
+  struct ts_stat stat;
+};
+
+// time series record of an interval ending at t, binary format as is
+
+struct ts_rec {
+  double t;
+  double throughput;  // delivered packets per mtu
+  double offered;     // generated packets per mtu
+  double util;        // channel utilisation
+  double mean_q;      // mean node queue length at t
+  double max_q;       // max node queue length at t
+  double drop_rate;   // dropped per generated packet
+  double ev_rate;     // simulator events per second
+};
+
+struct ts_sim * ts_sim_create();
+int ts_sim_configure(struct ts_sim *s, char *a);
+void ts_sim_init(struct ts_sim *s);
+int ts_sim_step(struct ts_sim *s, simtime until);
+void ts_sim_run(struct ts_sim *s);
+void ts_sim_stats(struct ts_sim *s, struct ts_stat *t);
+void ts_sim_print_input(struct ts_sim *s, FILE *f);
+void ts_sim_print_statistics(struct ts_sim *s, FILE *f);
+int ts_sim_describe(struct ts_sim *s, char *buf, int size);
+void ts_sim_reuse(struct ts_sim *s, struct ts_sim *old);
+struct inj_buf * ts_sim_trace(struct ts_sim *s);
+void ts_sim_trace_free(struct inj_buf *tr);
+void ts_sim_destroy(struct ts_sim *s);
+
+int error_exit(char message[]);
+extern __thread jmp_buf * ts_error_jmp; // set: error_exit returns there
+extern __thread char ts_error_msg[256];
+
+#endif
+
+// ts_sim.h end
@@ -0,0 +1,29 @@
+// ts_sim_int.h
+// kernels of ts_sim.c used by the microbenchmarks, not part of the library
+// interface; ts_sim.c includes it so the declarations follow the definitions
+
+#ifndef __TS_SIM_INT__
+#define __TS_SIM_INT__
+
+#include "ts_sim.h"
+
+int event_compare_content(void * x1, void *x2);
+int packet_find_content(void *x1, void *x2);
+void adr_diff(struct ts_sim *s, int *id,int *is, int *di);
+int node_number(int * i, int d, int *k);
+void node_index(int nn, int * i, int d, int *k);
+void next_hop(int * i,int * ii, int np, int d, int *k);
+double ran_expo(double lambda, unsigned int *rng);
+void expo_gaps(double *u, simtime *dt, int m, double lambda);
+void gen_dest( int * source, int * dest, int d, int *k, unsigned int *rng );
+int gen_dest_number( int src, int n_nodes, unsigned int *rng );
+int sw_pkt_rule_a(struct ts_sim *s, struct packet *p, int nn, unsigned int *rng);
+int sw_pkt_rule_b(struct ts_sim *s, struct packet *p, int nn, unsigned int *rng);
+int sw_pkt_rule_c(struct ts_sim *s, struct packet *p, int nn, unsigned int *rng);
+int sw_pkt_rule_d(struct ts_sim *s, struct packet *p, int nn, unsigned int *rng);
+int sw_pkt_rule_e(struct ts_sim *s, struct packet *p, int nn, unsigned int *rng);
+int sw_pkt_rule_f(struct ts_sim *s, struct packet *p, int nn, unsigned int *rng);
+
+#endif
+
+// ts_sim_int.h end
@@ -0,0 +1,84 @@
+// ts_stream.c
+// non-blocking record writer
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+
+#include "ts_stream.h"
+
+// path "-" is the standard output, a named pipe waits for its reader;
+// writes are non-blocking after the open
+struct ts_stream * ts_stream_open(char *path, long cap)
+{
+  struct ts_stream *w = calloc(1,sizeof(struct ts_stream));
+  int fl;
+
+  if( w==NULL ) return NULL;
+  w->buf = malloc(cap);
+  if( w->buf==NULL ) { free(w); return NULL; }
+  w->cap = cap;
+  if( strcmp(path,"-")==0 ) { fflush(stdout); w->fd = 1; }
+  else
+  {
+    w->fd = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0644);
+    w->own = 1;
+  }
+  if( w->fd < 0 ) { free(w->buf); free(w); return NULL; }
+  fl = fcntl(w->fd, F_GETFL);
+  if( w->own && fl >= 0 ) fcntl(w->fd, F_SETFL, fl|O_NONBLOCK);
+  return w;
+} /* ts_stream_open */
+
+// write out what the file accepts now
+void ts_stream_flush(struct ts_stream *w)
+{
+  long m;
+  ssize_t r;
+
+  while( w->len > 0 )
+  {
+    m = (w->head+w->len <= w->cap) ? w->len : w->cap-w->head;
+    r = write(w->fd, w->buf+w->head, m);
+    if( r < 0 && errno==EINTR ) continue;
+    if( r <= 0 ) return; // EAGAIN: reader is slow, retry at the next record
+    w->head = (w->head+r) % w->cap;
+    w->len -= r;
+  }
+} /* ts_stream_flush */
+
+// returns 0 when the record is dropped on a full buffer
+int ts_stream_put(struct ts_stream *w, void *rec, long size)
+{
+  long tail, m;
+
+  ts_stream_flush(w);
+  if( w->len+size > w->cap ) { w->lost++; return 0; }
+  tail = (w->head+w->len) % w->cap;
+  m = (tail+size <= w->cap) ? size : w->cap-tail;
+  memcpy(w->buf+tail, rec, m);
+  memcpy(w->buf, (char *)rec+m, size-m);
+  w->len += size;
+  ts_stream_flush(w);
+  return 1;
+} /* ts_stream_put */
+
+// blocking flush of the rest
+void ts_stream_close(struct ts_stream *w)
+{
+  int fl;
+
+  if( w==NULL ) return;
+  fl = fcntl(w->fd, F_GETFL);
+  if( w->own && fl >= 0 ) fcntl(w->fd, F_SETFL, fl & ~O_NONBLOCK);
+  ts_stream_flush(w);
+  if( w->lost > 0 ) fprintf(stderr,"*** warning: %ld statistics records lost\n",w->lost);
+  if( w->own ) close(w->fd);
+  free(w->buf);
+  free(w);
+} /* ts_stream_close */
+
+// ts_stream.c end
@@ -0,0 +1,25 @@
+// ts_stream.h
+// non-blocking record writer: records are appended to a ring buffer and
+// written to a file or pipe without waiting, the rest is flushed at close
+
+#ifndef __TS_STREAM__
+#define __TS_STREAM__
+
+struct ts_stream {
+  int fd;
+  int own;        // fd opened by the stream
+  char * buf;     // ring buffer
+  long cap;
+  long head;      // next byte to write out
+  long len;       // bytes in the buffer
+  long lost;      // records dropped on a full buffer
+};
+
+struct ts_stream * ts_stream_open(char *path, long cap);
+int ts_stream_put(struct ts_stream *w, void *rec, long size);
+void ts_stream_flush(struct ts_stream *w);
+void ts_stream_close(struct ts_stream *w);
+
+#endif
+
+// ts_stream.h end